@@ -0,0 +1,85 @@
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../src/chip8.h"
+
+//Runs each ROM with its chip8-aot translation and with the interpreter alone, checks that both produce the same
+//framebuffer after every frame and reports the speedup. Only ROMs listed in CHIP8_AOT_ROMS have a translation.
+//Usage: aot_bench rom.ch8... [-f frames] [-i ipf]
+
+int main(int argc, char *argv[]) {
+    int frames = 600;
+    int ipf = 1000;
+    std::vector<std::string> roms;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            ipf = atoi(argv[++i]);
+        } else {
+            roms.emplace_back(argv[i]);
+        }
+    }
+    if (roms.empty()) {
+        std::cerr << "Usage: aot_bench rom.ch8... [-f frames] [-i ipf]\n";
+        return 0;
+    }
+
+    SDL_Init(0);
+    int mismatches = 0;
+
+    for (const std::string &rom: roms) {
+        Chip8 native(rom, false, true, true, false);
+        Chip8 interpreter(rom, false, true, true, false);
+        if (!native.isRunning()) {
+            continue;
+        }
+        if (!native.has_native_code()) {
+            std::cout << std::format("{}: no native code linked in, add it to CHIP8_AOT_ROMS\n", rom);
+            continue;
+        }
+        interpreter.set_native_code(false);
+        //the same random numbers, and every instruction executed so both count the same work
+        native.seed_random(1);
+        interpreter.seed_random(1);
+        native.set_idle_skip(false);
+        interpreter.set_idle_skip(false);
+
+        std::chrono::steady_clock::duration native_time{0}, interpreter_time{0};
+        int frame = 0;
+        for (; frame < frames && native.isRunning() && interpreter.isRunning(); ++frame) {
+            auto start = std::chrono::steady_clock::now();
+            native.decrement_timers();
+            native.run_frame(ipf);
+            auto middle = std::chrono::steady_clock::now();
+            interpreter.decrement_timers();
+            interpreter.run_frame(ipf);
+            auto end = std::chrono::steady_clock::now();
+            native_time += middle - start;
+            interpreter_time += end - middle;
+
+            if (native.take_draw_flag() != interpreter.take_draw_flag() ||
+                memcmp(native.get_display(), interpreter.get_display(), LOGICAL_WIDTH * LOGICAL_HEIGHT) != 0 ||
+                native.instructions_executed() != interpreter.instructions_executed()) {
+                std::cout << std::format("{}: framebuffer differs from the interpreter at frame {}\n", rom, frame);
+                mismatches++;
+                break;
+            }
+        }
+
+        double native_rate = native.instructions_executed() / std::chrono::duration<double>(native_time).count();
+        double interpreter_rate =
+                interpreter.instructions_executed() / std::chrono::duration<double>(interpreter_time).count();
+        std::cout << std::format("{}: {} frames, interpreter {:.2f} M instr/s, native {:.2f} M instr/s ({:.2f}x), "
+                                 "{:.1f}% of instructions native\n",
+                                 rom, frame, interpreter_rate / 1e6, native_rate / 1e6,
+                                 native_rate / interpreter_rate,
+                                 100.0 * native.native_instructions() / native.instructions_executed());
+    }
+
+    SDL_Quit();
+    return mismatches;
+}
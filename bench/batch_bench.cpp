@@ -0,0 +1,71 @@
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "../src/batch.h"
+#include "../src/chip8.h"
+
+//Compares machine-instructions per second of the lockstep batch engine against the same number of
+//independent Chip8 interpreters run one after another on one thread.
+//Usage: batch_bench rom.ch8 [frames] [ipf]
+
+template<typename Func>
+static double time_seconds(Func func) {
+    auto start = std::chrono::steady_clock::now();
+    func();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: batch_bench rom.ch8 [frames] [ipf]\n";
+        return 0;
+    }
+    std::string rom = argv[1];
+    int frames = argc > 2 ? atoi(argv[2]) : 600;
+    int ipf = argc > 3 ? atoi(argv[3]) : 1000;
+
+    SDL_Init(0);
+
+    for (int lanes: {8, 16, 32}) {
+        std::vector<std::unique_ptr<Chip8>> machines;
+        for (int l = 0; l < lanes; ++l) {
+            machines.push_back(std::make_unique<Chip8>(rom, false, true, true, false));
+            //the batch engine always executes every instruction, so compare like for like
+            machines.back()->set_idle_skip(false);
+        }
+
+        uint64_t interpreter_instructions = 0;
+        double interpreter_time = time_seconds([&] {
+            for (int f = 0; f < frames; ++f) {
+                for (auto &machine: machines) {
+                    machine->decrement_timers();
+                    machine->run_frame(ipf);
+                    machine->take_draw_flag();
+                }
+            }
+        });
+        for (auto &machine: machines) {
+            interpreter_instructions += machine->instructions_executed();
+        }
+
+        BatchChip8 batch(rom, lanes, true, 1);
+        double batch_time = time_seconds([&] {
+            for (int f = 0; f < frames; ++f) {
+                batch.decrement_timers();
+                batch.run_frame(ipf);
+            }
+        });
+
+        double interpreter_rate = interpreter_instructions / interpreter_time;
+        double batch_rate = batch.instructions_executed() / batch_time;
+        std::cout << std::format("{:>2} machines: interpreters {:>8.2f} M instr/s, batch {:>8.2f} M instr/s ({:.2f}x), "
+                                 "{} lockstep / {} single steps, {} divergent frames\n",
+                                 lanes, interpreter_rate / 1e6, batch_rate / 1e6, batch_rate / interpreter_rate,
+                                 batch.lockstep_steps(), batch.single_steps(), batch.divergent_frames());
+    }
+
+    SDL_Quit();
+    return 0;
+}
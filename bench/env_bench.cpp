@@ -0,0 +1,49 @@
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "../src/environment.h"
+
+//Measures environment frames per second of VectorEnv stepping with random actions into a caller owned buffer.
+//Usage: env_bench rom.ch8 [environments] [threads] [steps] [frames_per_step]
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: env_bench rom.ch8 [environments] [threads] [steps] [frames_per_step]\n";
+        return 0;
+    }
+    int count = argc > 2 ? atoi(argv[2]) : 1024;
+    int threads = argc > 3 ? atoi(argv[3]) : 0;
+    int steps = argc > 4 ? atoi(argv[4]) : 1000;
+    int frames_per_step = argc > 5 ? atoi(argv[5]) : 4;
+
+    VectorEnv env(argv[1], count, threads, true, 11);
+    if (!env.is_loaded()) {
+        return 0;
+    }
+
+    std::vector<uint8_t> observations(count * OBSERVATION_SIZE);
+    env.set_observation_buffer(observations.data());
+    env.reset(1);
+
+    std::mt19937 rng(1);
+    std::vector<uint16_t> actions(count);
+    uint64_t episodes = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int s = 0; s < steps; ++s) {
+        for (uint16_t &action: actions) {
+            action = 1 << (rng() % KEY_COUNT);
+        }
+        env.step(actions.data(), frames_per_step);
+        for (int i = 0; i < count; ++i) {
+            episodes += env.dones()[i];
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << std::format("{} environments, {} steps of {} frames: {:.2f} M frames/s, {} episodes ended\n",
+                             count, steps, frames_per_step, env.frames_run() / seconds / 1e6, episodes);
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "../src/pixel_expand.h"
+
+//Compares the palette expansion kernels against the original per pixel loop from Screen::draw
+//at every display resolution we support. Run with an optional iteration count.
+
+struct Resolution {
+    int width;
+    int height;
+    const char *name;
+};
+
+const Resolution RESOLUTIONS[] = {
+        {64,  32, "CHIP-8"},
+        {128, 64, "SUPER-CHIP / XO-CHIP hires"},
+};
+
+//prevents the compiler from optimizing the output away
+static volatile uint32_t sink;
+
+template<typename Func>
+static double time_ns_per_frame(int iterations, Func func) {
+    func();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        func();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+static void report(const char *name, double ns, int pixels, double baseline_ns) {
+    std::cout << std::format("  {:<24} {:>10.1f} ns/frame {:>10.1f} Mpx/s {:>7.2f}x\n",
+                             name, ns, pixels / ns * 1000.0, baseline_ns / ns);
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+    std::mt19937 gen{1234};
+
+    for (const Resolution &res: RESOLUTIONS) {
+        int pixels = res.width * res.height;
+        std::vector<uint8_t> display(pixels);
+        for (uint8_t &pixel: display) {
+            pixel = gen() & 3;
+        }
+        std::vector<uint32_t> texture(pixels);
+
+        std::cout << std::format("{}x{} ({}), {} iterations\n", res.width, res.height, res.name, iterations);
+
+        //the loop Screen::draw used before the kernels, including the copy out of the stack buffer
+        double baseline = time_ns_per_frame(iterations, [&] {
+            uint32_t screen[128 * 64];
+            for (int i = 0; i < pixels; i++) {
+                screen[i] = (display[i] == 1) ? UINT32_MAX : 0;
+            }
+            memcpy(texture.data(), screen, pixels * sizeof(uint32_t));
+            sink = texture[pixels - 1];
+        });
+        report("original loop", baseline, pixels, baseline);
+
+        for (ExpandKernel kernel: {ExpandKernel::Scalar, ExpandKernel::SSE2, ExpandKernel::AVX2}) {
+            if (!expand_kernel_supported(kernel)) {
+                std::cout << std::format("  {:<24} not supported on this CPU\n", expand_kernel_name(kernel));
+                continue;
+            }
+            for (int planes = 1; planes <= 2; ++planes) {
+                double ns = time_ns_per_frame(iterations, [&] {
+                    expand_pixels(display.data(), res.width, res.height, planes, DEFAULT_PALETTE, texture.data(),
+                                  res.width * sizeof(uint32_t), kernel);
+                    sink = texture[pixels - 1];
+                });
+                report(std::format("{} {} plane{}", expand_kernel_name(kernel), planes, planes > 1 ? "s" : "").c_str(),
+                       ns, pixels, baseline);
+            }
+        }
+    }
+
+    return 0;
+}
@@ -16,6 +16,18 @@ void Audio::init_audio() {
 void callback(void* userdata, SDL_AudioStream *stream, int additional_amount, int total_amount) {
     Audio *audio = (Audio *) userdata;
     int len = additional_amount / sizeof(int16_t);
+    if (len <= 0) {
+        return;
+    }
+
+    //the device asks for more before the samples it was given have been played, so a call that comes later
+    //than that (with some slack for scheduling) means it played silence in between
+    uint64_t now = SDL_GetTicksNS();
+    if (audio->last_callback != 0 && now - audio->last_callback > audio->supplied_ns * 3 / 2) {
+        audio->underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+    audio->last_callback = now;
+    audio->supplied_ns = static_cast<uint64_t>(len) * 1000000000 / SAMPLE_RATE;
     int16_t buff[len];
     for(int i = 0; i < len; i++) {
         if(audio->is_beeping)
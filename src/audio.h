@@ -2,6 +2,8 @@
 #define CHIP8_AUDIO_H
 
 #include <SDL3/SDL.h>
+#include <atomic>
+#include <cstdint>
 
 
 const int SAMPLE_RATE = 44100;
@@ -14,9 +16,20 @@ public:
     int phase = 0;
 
     void init_audio();
+
+    //times the device ran out of samples, read from other threads
+    uint64_t underrun_count() const { return underruns.load(std::memory_order_relaxed); }
+
 private:
     SDL_AudioStream *audio_stream;
 
+    //the rest is only touched by callback, on the audio thread
+    std::atomic<uint64_t> underruns{0};
+    uint64_t last_callback = 0;
+    uint64_t supplied_ns = 0;
+
+    friend void callback(void *userdata, SDL_AudioStream *stream, int additional_amount, int total_amount);
+
 };
 
 void callback(void *userdata, SDL_AudioStream *stream, int additional_amount, int total_amount);
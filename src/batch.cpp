@@ -0,0 +1,569 @@
+#include "batch.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CHIP8_X86 1
+#include <immintrin.h>
+#endif
+
+
+namespace {
+
+//ALU operations that are applied to whole register rows. VX is always written before VF so VF = flag
+//wins when X is F, matching Chip8::opcode_8XY_
+enum class AluOp {
+    Set, Or, And, Xor, Add, Sub, ShiftRight, SubReverse, ShiftLeft, AddNoFlag
+};
+
+bool has_avx2() {
+#ifdef CHIP8_X86
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+void expand_mask_scalar(uint32_t group, uint8_t *mask) {
+    for (int l = 0; l < BATCH_MAX_LANES; ++l) {
+        mask[l] = (group >> l) & 1 ? 0xFF : 0;
+    }
+}
+
+void alu_scalar(AluOp op, uint8_t *vx, const uint8_t *vy, uint8_t *vf, const uint8_t *mask) {
+    uint8_t x_out[BATCH_MAX_LANES];
+    uint8_t flag[BATCH_MAX_LANES];
+
+    for (int l = 0; l < BATCH_MAX_LANES; ++l) {
+        uint8_t x = vx[l];
+        uint8_t y = vy[l];
+        flag[l] = 0;
+        switch (op) {
+            case AluOp::Set: x_out[l] = y; break;
+            case AluOp::Or: x_out[l] = x | y; break;
+            case AluOp::And: x_out[l] = x & y; break;
+            case AluOp::Xor: x_out[l] = x ^ y; break;
+            case AluOp::Add:
+            case AluOp::AddNoFlag:
+                x_out[l] = x + y;
+                flag[l] = (x + y) > 255;
+                break;
+            case AluOp::Sub: x_out[l] = x - y; flag[l] = x >= y; break;
+            case AluOp::ShiftRight: x_out[l] = y >> 1; flag[l] = y & 1; break;
+            case AluOp::SubReverse: x_out[l] = y - x; flag[l] = y >= x; break;
+            case AluOp::ShiftLeft: x_out[l] = y << 1; flag[l] = y >> 7; break;
+        }
+    }
+
+    for (int l = 0; l < BATCH_MAX_LANES; ++l) {
+        vx[l] = mask[l] ? x_out[l] : vx[l];
+    }
+    if (op != AluOp::Set && op != AluOp::AddNoFlag) {
+        for (int l = 0; l < BATCH_MAX_LANES; ++l) {
+            vf[l] = mask[l] ? flag[l] : vf[l];
+        }
+    }
+}
+
+//adds delta to PC in every lane where cond is set
+void add_pc_scalar(uint16_t *pc, const uint8_t *cond, int16_t delta) {
+    for (int l = 0; l < BATCH_MAX_LANES; ++l) {
+        pc[l] += cond[l] ? delta : 0;
+    }
+}
+
+uint32_t match_pc_scalar(const uint16_t *pc, uint16_t value) {
+    uint32_t result = 0;
+    for (int l = 0; l < BATCH_MAX_LANES; ++l) {
+        result |= static_cast<uint32_t>(pc[l] == value) << l;
+    }
+    return result;
+}
+
+#ifdef CHIP8_X86
+
+__attribute__((target("avx2")))
+void expand_mask_avx2(uint32_t group, uint8_t *mask) {
+    //copy byte l / 8 of the group into byte l, then test bit l % 8
+    const __m256i select = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                            2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bits = _mm256_set1_epi64x(static_cast<int64_t>(0x8040201008040201ULL));
+    __m256i bytes = _mm256_shuffle_epi8(_mm256_set1_epi32(static_cast<int>(group)), select);
+    __m256i out = _mm256_cmpeq_epi8(_mm256_and_si256(bytes, bits), bits);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(mask), out);
+}
+
+__attribute__((target("avx2")))
+void alu_avx2(AluOp op, uint8_t *vx, const uint8_t *vy, uint8_t *vf, const uint8_t *mask) {
+    const __m256i one = _mm256_set1_epi8(1);
+    __m256i x = _mm256_load_si256(reinterpret_cast<const __m256i *>(vx));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(vy));
+    __m256i m = _mm256_load_si256(reinterpret_cast<const __m256i *>(mask));
+    __m256i x_out;
+    __m256i flag = _mm256_setzero_si256();
+
+    switch (op) {
+        case AluOp::Set: x_out = y; break;
+        case AluOp::Or: x_out = _mm256_or_si256(x, y); break;
+        case AluOp::And: x_out = _mm256_and_si256(x, y); break;
+        case AluOp::Xor: x_out = _mm256_xor_si256(x, y); break;
+        case AluOp::Add:
+        case AluOp::AddNoFlag:
+            x_out = _mm256_add_epi8(x, y);
+            //the sum wrapped if it is smaller than x
+            flag = _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(x_out, x), x_out), one);
+            break;
+        case AluOp::Sub:
+            x_out = _mm256_sub_epi8(x, y);
+            flag = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(x, y), x), one);
+            break;
+        case AluOp::ShiftRight:
+            //there is no 8 bit shift, shift 16 bit lanes and clear the bit pulled in from the neighbouring byte
+            x_out = _mm256_and_si256(_mm256_srli_epi16(y, 1), _mm256_set1_epi8(0x7F));
+            flag = _mm256_and_si256(y, one);
+            break;
+        case AluOp::SubReverse:
+            x_out = _mm256_sub_epi8(y, x);
+            flag = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(y, x), y), one);
+            break;
+        case AluOp::ShiftLeft:
+            x_out = _mm256_add_epi8(y, y);
+            flag = _mm256_and_si256(_mm256_srli_epi16(y, 7), one);
+            break;
+    }
+
+    _mm256_store_si256(reinterpret_cast<__m256i *>(vx), _mm256_blendv_epi8(x, x_out, m));
+    if (op != AluOp::Set && op != AluOp::AddNoFlag) {
+        __m256i f = _mm256_load_si256(reinterpret_cast<const __m256i *>(vf));
+        _mm256_store_si256(reinterpret_cast<__m256i *>(vf), _mm256_blendv_epi8(f, flag, m));
+    }
+}
+
+__attribute__((target("avx2")))
+void add_pc_avx2(uint16_t *pc, const uint8_t *cond, int16_t delta) {
+    __m256i c = _mm256_load_si256(reinterpret_cast<const __m256i *>(cond));
+    __m256i d = _mm256_set1_epi16(delta);
+    //sign extending the byte masks gives 16 bit masks for the two halves of the PC row
+    __m256i lo = _mm256_and_si256(_mm256_cvtepi8_epi16(_mm256_castsi256_si128(c)), d);
+    __m256i hi = _mm256_and_si256(_mm256_cvtepi8_epi16(_mm256_extracti128_si256(c, 1)), d);
+    auto *row = reinterpret_cast<__m256i *>(pc);
+    _mm256_store_si256(row, _mm256_add_epi16(_mm256_load_si256(row), lo));
+    _mm256_store_si256(row + 1, _mm256_add_epi16(_mm256_load_si256(row + 1), hi));
+}
+
+__attribute__((target("avx2")))
+uint32_t match_pc_avx2(const uint16_t *pc, uint16_t value) {
+    const auto *row = reinterpret_cast<const __m256i *>(pc);
+    __m256i v = _mm256_set1_epi16(static_cast<short>(value));
+    __m256i lo = _mm256_cmpeq_epi16(_mm256_load_si256(row), v);
+    __m256i hi = _mm256_cmpeq_epi16(_mm256_load_si256(row + 1), v);
+    //packing works within 128 bit halves, so put the quarters back in lane order before taking the mask
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(lo, hi), 0xD8);
+    return static_cast<uint32_t>(_mm256_movemask_epi8(packed));
+}
+
+#endif
+
+void expand_mask(uint32_t group, uint8_t *mask) {
+#ifdef CHIP8_X86
+    if (has_avx2()) return expand_mask_avx2(group, mask);
+#endif
+    expand_mask_scalar(group, mask);
+}
+
+void alu(AluOp op, uint8_t *vx, const uint8_t *vy, uint8_t *vf, const uint8_t *mask) {
+#ifdef CHIP8_X86
+    if (has_avx2()) return alu_avx2(op, vx, vy, vf, mask);
+#endif
+    alu_scalar(op, vx, vy, vf, mask);
+}
+
+void add_pc(uint16_t *pc, const uint8_t *cond, int16_t delta) {
+#ifdef CHIP8_X86
+    if (has_avx2()) return add_pc_avx2(pc, cond, delta);
+#endif
+    add_pc_scalar(pc, cond, delta);
+}
+
+uint32_t match_pc(const uint16_t *pc, uint16_t value) {
+#ifdef CHIP8_X86
+    if (has_avx2()) return match_pc_avx2(pc, value);
+#endif
+    return match_pc_scalar(pc, value);
+}
+
+//skips the next instruction in every masked lane where (a == b) == equal
+void skip_if(uint16_t *pc, const uint8_t *a, const uint8_t *b, bool equal, const uint8_t *mask) {
+    alignas(32) uint8_t cond[BATCH_MAX_LANES];
+    for (int l = 0; l < BATCH_MAX_LANES; ++l) {
+        cond[l] = ((a[l] == b[l]) == equal) ? mask[l] : 0;
+    }
+    add_pc(pc, cond, 2);
+}
+
+template<typename T>
+void set_masked(T *row, T value, const uint8_t *mask) {
+    for (int l = 0; l < BATCH_MAX_LANES; ++l) {
+        row[l] = mask[l] ? value : row[l];
+    }
+}
+
+}
+
+
+BatchChip8::BatchChip8(const std::string &fname, int _lanes, bool increment_I, uint32_t seed)
+        : lanes(std::clamp(_lanes, 1, BATCH_MAX_LANES)), increment_I_on_index(increment_I),
+          memory(lanes * MEMORY_SIZE, 0), display(lanes * LOGICAL_WIDTH * LOGICAL_HEIGHT, 0) {
+    bool loaded = load_ROM(fname);
+    for (int l = 0; l < lanes; ++l) {
+        memcpy(lane_memory(l) + FONT_START, FONTSET, sizeof(uint8_t) * FONTSET_SIZE);
+        PC[l] = PROGRAM_START;
+        running[l] = loaded;
+        //xorshift needs a non-zero state
+        rng[l] = (seed + l) * 2654435761u | 1;
+    }
+}
+
+bool BatchChip8::load_ROM(const std::string &fname) {
+    std::ifstream file(fname, std::ios::binary | std::ios::ate);
+    if (!file) {
+        std::cerr << "ERROR: Failed to open input file\n";
+        return false;
+    }
+
+    std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    if (size > MEMORY_SIZE - PROGRAM_START) {
+        std::cerr << "ERROR: Input file is too big\n";
+        return false;
+    }
+
+    file.read(reinterpret_cast<char *>(lane_memory(0) + PROGRAM_START), size);
+    for (int l = 1; l < lanes; ++l) {
+        memcpy(lane_memory(l) + PROGRAM_START, lane_memory(0) + PROGRAM_START, size);
+    }
+    return true;
+}
+
+bool BatchChip8::any_running() const {
+    for (int l = 0; l < lanes; ++l) {
+        if (running[l]) return true;
+    }
+    return false;
+}
+
+void BatchChip8::set_keys(int lane, uint16_t pressed) {
+    pending_keys[lane] = pressed;
+}
+
+void BatchChip8::decrement_timers() {
+    for (int l = 0; l < BATCH_MAX_LANES; ++l) {
+        delay[l] -= delay[l] > 0;
+        sound[l] -= sound[l] > 0;
+    }
+}
+
+uint32_t BatchChip8::active_lanes() const {
+    uint32_t active = 0;
+    for (int l = 0; l < lanes; ++l) {
+        active |= static_cast<uint32_t>(running[l] && remaining[l] > 0 && !frame_drawn[l]) << l;
+    }
+    return active;
+}
+
+uint32_t BatchChip8::matching_lanes(uint32_t candidates, int leader, uint16_t opcode) const {
+    uint16_t pc = PC[leader];
+    uint32_t group = match_pc(PC, pc) & candidates;
+
+    //only lanes that wrote to this instruction can have a different opcode at the same PC
+    if (pc + 1 >= written_low && pc <= written_high) {
+        for (uint32_t rest = group; rest; rest &= rest - 1) {
+            int l = std::countr_zero(rest);
+            const uint8_t *mem = &memory[l * MEMORY_SIZE];
+            if ((mem[pc] << 8 | mem[pc + 1]) != opcode) {
+                group &= ~(1u << l);
+            }
+        }
+    }
+    return group;
+}
+
+void BatchChip8::run_frame(int ipf) {
+    for (int l = 0; l < lanes; ++l) {
+        remaining[l] = ipf;
+        frame_drawn[l] = false;
+        prev_keys[l] = keys[l];
+        keys[l] = pending_keys[l];
+    }
+
+    bool lockstep = true;
+    uint32_t active;
+    while ((active = active_lanes()) != 0) {
+        int leader = std::countr_zero(active);
+        uint16_t pc = PC[leader];
+        if (pc + 1 >= MEMORY_SIZE) {
+            std::cerr << "ERROR: Reached end of instructions\n";
+            stop_lane(leader);
+            continue;
+        }
+
+        const uint8_t *mem = lane_memory(leader);
+        uint16_t opcode = mem[pc] << 8 | mem[pc + 1];
+
+        uint32_t group = 1u << leader;
+        if (lockstep) {
+            group = matching_lanes(active, leader, opcode);
+            if (std::popcount(group) < divergence_limit * std::popcount(active)) {
+                //the lanes have spread out too far to gain anything from lockstep, finish the frame lane by lane
+                lockstep = false;
+                divergent_frame_count++;
+                group = 1u << leader;
+            }
+        }
+
+        if (std::popcount(group) > 1) lockstep_count++;
+        else single_count++;
+        instruction_count += std::popcount(group);
+
+        for (uint32_t rest = group; rest; rest &= rest - 1) {
+            remaining[std::countr_zero(rest)]--;
+        }
+        execute(opcode, group);
+    }
+}
+
+void BatchChip8::execute(uint16_t opcode, uint32_t group) {
+    alignas(32) uint8_t mask[BATCH_MAX_LANES];
+    alignas(32) uint8_t imm[BATCH_MAX_LANES];
+    expand_mask(group, mask);
+    add_pc(PC, mask, 2);
+
+    uint8_t X = (opcode & 0x0F00) >> 8;
+    uint8_t Y = (opcode & 0x00F0) >> 4;
+    uint8_t N = opcode & 0x000F;
+    uint8_t NN = opcode & 0x00FF;
+    uint16_t NNN = opcode & 0x0FFF;
+
+    switch (opcode >> 12) {
+        case 0x0:
+            if (NN == 0xE0) {
+                for (uint32_t rest = group; rest; rest &= rest - 1) {
+                    int l = std::countr_zero(rest);
+                    memset(&display[l * LOGICAL_WIDTH * LOGICAL_HEIGHT], 0, LOGICAL_WIDTH * LOGICAL_HEIGHT);
+                    draw_flag[l] = frame_drawn[l] = true;
+                }
+            } else if (NN == 0xEE) {
+                for (uint32_t rest = group; rest; rest &= rest - 1) {
+                    int l = std::countr_zero(rest);
+                    if (SP[l] == 0) {
+                        std::cerr << "ERROR: Attempted stack underflow.\n";
+                        stop_lane(l);
+                    } else {
+                        PC[l] = stack[--SP[l]][l];
+                    }
+                }
+            } else {
+                for (uint32_t rest = group; rest; rest &= rest - 1) stop_lane(std::countr_zero(rest));
+            }
+            break;
+        case 0x1:
+            set_masked<uint16_t>(PC, NNN, mask);
+            break;
+        case 0x2:
+            for (uint32_t rest = group; rest; rest &= rest - 1) {
+                int l = std::countr_zero(rest);
+                if (SP[l] >= STACK_SIZE) {
+                    std::cerr << "ERROR: Attempted stack overflow.\n";
+                    stop_lane(l);
+                } else {
+                    stack[SP[l]++][l] = PC[l];
+                    PC[l] = NNN;
+                }
+            }
+            break;
+        case 0x3:
+        case 0x4:
+            memset(imm, NN, sizeof(imm));
+            skip_if(PC, V[X], imm, (opcode >> 12) == 0x3, mask);
+            break;
+        case 0x5:
+        case 0x9:
+            if (N != 0) {
+                for (uint32_t rest = group; rest; rest &= rest - 1) stop_lane(std::countr_zero(rest));
+                break;
+            }
+            skip_if(PC, V[X], V[Y], (opcode >> 12) == 0x5, mask);
+            break;
+        case 0x6:
+            set_masked<uint8_t>(V[X], NN, mask);
+            break;
+        case 0x7:
+            memset(imm, NN, sizeof(imm));
+            alu(AluOp::AddNoFlag, V[X], imm, V[0xF], mask);
+            break;
+        case 0x8:
+            execute_8XY_(opcode, mask, group);
+            break;
+        case 0xA:
+            set_masked<uint16_t>(I, NNN, mask);
+            break;
+        case 0xB:
+            for (int l = 0; l < BATCH_MAX_LANES; ++l) {
+                PC[l] = mask[l] ? NNN + V[0][l] : PC[l];
+            }
+            break;
+        case 0xC:
+            for (int l = 0; l < BATCH_MAX_LANES; ++l) {
+                uint32_t r = rng[l];
+                r ^= r << 13;
+                r ^= r >> 17;
+                r ^= r << 5;
+                rng[l] = mask[l] ? r : rng[l];
+                V[X][l] = mask[l] ? (r & NN) : V[X][l];
+            }
+            break;
+        case 0xD:
+            for (uint32_t rest = group; rest; rest &= rest - 1) {
+                draw_sprite(std::countr_zero(rest), X, Y, N);
+            }
+            break;
+        case 0xE:
+            if (NN != 0x9E && NN != 0xA1) {
+                for (uint32_t rest = group; rest; rest &= rest - 1) stop_lane(std::countr_zero(rest));
+                break;
+            }
+            for (int l = 0; l < BATCH_MAX_LANES; ++l) {
+                bool pressed = (keys[l] >> (V[X][l] & 0xF)) & 1;
+                imm[l] = pressed == (NN == 0x9E) ? mask[l] : 0;
+            }
+            add_pc(PC, imm, 2);
+            break;
+        case 0xF:
+            execute_FX_(opcode, mask, group);
+            break;
+    }
+}
+
+void BatchChip8::execute_8XY_(uint16_t opcode, const uint8_t *mask, uint32_t group) {
+    uint8_t X = (opcode & 0x0F00) >> 8;
+    uint8_t Y = (opcode & 0x00F0) >> 4;
+
+    AluOp op;
+    switch (opcode & 0x000F) {
+        case 0x0: op = AluOp::Set; break;
+        case 0x1: op = AluOp::Or; break;
+        case 0x2: op = AluOp::And; break;
+        case 0x3: op = AluOp::Xor; break;
+        case 0x4: op = AluOp::Add; break;
+        case 0x5: op = AluOp::Sub; break;
+        case 0x6: op = AluOp::ShiftRight; break;
+        case 0x7: op = AluOp::SubReverse; break;
+        case 0xE: op = AluOp::ShiftLeft; break;
+        default:
+            for (uint32_t rest = group; rest; rest &= rest - 1) stop_lane(std::countr_zero(rest));
+            return;
+    }
+    alu(op, V[X], V[Y], V[0xF], mask);
+}
+
+void BatchChip8::execute_FX_(uint16_t opcode, const uint8_t *mask, uint32_t group) {
+    uint8_t X = (opcode & 0x0F00) >> 8;
+
+    switch (opcode & 0x00FF) {
+        case 0x07:
+            for (int l = 0; l < BATCH_MAX_LANES; ++l) V[X][l] = mask[l] ? delay[l] : V[X][l];
+            break;
+        case 0x0A:
+            for (uint32_t rest = group; rest; rest &= rest - 1) {
+                int l = std::countr_zero(rest);
+                uint16_t released = prev_keys[l] & ~keys[l];
+                if (released) {
+                    V[X][l] = std::countr_zero(released);
+                } else {
+                    PC[l] -= 2;
+                }
+            }
+            break;
+        case 0x15:
+            for (int l = 0; l < BATCH_MAX_LANES; ++l) delay[l] = mask[l] ? V[X][l] : delay[l];
+            break;
+        case 0x18:
+            for (int l = 0; l < BATCH_MAX_LANES; ++l) sound[l] = mask[l] ? V[X][l] : sound[l];
+            break;
+        case 0x1E:
+            for (int l = 0; l < BATCH_MAX_LANES; ++l) I[l] += mask[l] ? V[X][l] : 0;
+            break;
+        case 0x29:
+            for (int l = 0; l < BATCH_MAX_LANES; ++l) {
+                I[l] = mask[l] ? FONT_START + (V[X][l] & 0x0F) * 5 : I[l];
+            }
+            break;
+        case 0x33:
+            for (uint32_t rest = group; rest; rest &= rest - 1) {
+                int l = std::countr_zero(rest);
+                uint8_t val = V[X][l];
+                for (int i = 2; i >= 0; --i) {
+                    lane_memory(l)[(I[l] + i) & (MEMORY_SIZE - 1)] = val % 10;
+                    val /= 10;
+                }
+                note_write(I[l], 3);
+            }
+            break;
+        case 0x55:
+            for (uint32_t rest = group; rest; rest &= rest - 1) {
+                int l = std::countr_zero(rest);
+                for (int r = 0; r <= X; ++r) lane_memory(l)[(I[l] + r) & (MEMORY_SIZE - 1)] = V[r][l];
+                note_write(I[l], X + 1);
+                if (increment_I_on_index) I[l] += X + 1;
+            }
+            break;
+        case 0x65:
+            for (uint32_t rest = group; rest; rest &= rest - 1) {
+                int l = std::countr_zero(rest);
+                for (int r = 0; r <= X; ++r) V[r][l] = lane_memory(l)[(I[l] + r) & (MEMORY_SIZE - 1)];
+                if (increment_I_on_index) I[l] += X + 1;
+            }
+            break;
+        default:
+            for (uint32_t rest = group; rest; rest &= rest - 1) stop_lane(std::countr_zero(rest));
+    }
+}
+
+void BatchChip8::draw_sprite(int lane, uint8_t X, uint8_t Y, uint8_t N) {
+    uint8_t *screen = &display[lane * LOGICAL_WIDTH * LOGICAL_HEIGHT];
+    const uint8_t *mem = lane_memory(lane);
+    uint8_t x = V[X][lane] % LOGICAL_WIDTH;
+    uint8_t y = V[Y][lane] % LOGICAL_HEIGHT;
+    uint8_t collision = 0;
+
+    for (uint8_t y_coord = 0; y_coord < N && y + y_coord < LOGICAL_HEIGHT; ++y_coord) {
+        uint8_t pixel = mem[(I[lane] + y_coord) & (MEMORY_SIZE - 1)];
+        for (uint8_t x_coord = 0; x_coord < 8 && x + x_coord < LOGICAL_WIDTH; ++x_coord) {
+            if ((pixel & (0x80 >> x_coord)) != 0) {
+                uint8_t &target = screen[x + x_coord + (y + y_coord) * LOGICAL_WIDTH];
+                collision |= target;
+                target ^= 1;
+            }
+        }
+    }
+
+    V[0xF][lane] = collision;
+    draw_flag[lane] = frame_drawn[lane] = true;
+}
+
+void BatchChip8::note_write(int address, int length) {
+    //writes wrap around the end of the lane's memory like every other access
+    address &= MEMORY_SIZE - 1;
+    if (address + length > MEMORY_SIZE) {
+        written_low = 0;
+        written_high = MEMORY_SIZE - 1;
+        return;
+    }
+    written_low = std::min(written_low, address);
+    written_high = std::max(written_high, address + length - 1);
+}
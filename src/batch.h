@@ -0,0 +1,127 @@
+#ifndef CHIP8_BATCH_H
+#define CHIP8_BATCH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "chip8.h"
+
+//registers are stored as rows of this many lanes regardless of how many machines are used,
+//so one AVX2 register holds a whole row of 8 bit registers
+const int BATCH_MAX_LANES = 32;
+
+//if fewer than this fraction of the unfinished lanes share the leader's PC, the rest of the frame is run per lane
+const double DEFAULT_DIVERGENCE_LIMIT = 0.5;
+
+//Runs up to 32 copies of the same ROM in lockstep. Registers are stored as structure-of-arrays rows,
+//so an instruction is fetched and decoded once and then applied to every lane at the same PC.
+//Lanes that diverge wait until the leading lane's group has moved on, and if too many lanes diverge the
+//remainder of the frame is run one lane at a time.
+class BatchChip8 {
+public:
+    //each lane gets its own random number generator, seeded from seed and the lane number
+    BatchChip8(const std::string &fname, int _lanes, bool increment_I, uint32_t seed);
+
+    int lane_count() const { return lanes; }
+
+    //sets the keys held by a lane from the next frame on, bit i is key i
+    void set_keys(int lane, uint16_t pressed);
+
+    void decrement_timers();
+
+    //runs up to ipf instructions on every lane, a lane stops early after a draw like Chip8::run_frame
+    void run_frame(int ipf);
+
+    void set_divergence_limit(double limit) { divergence_limit = limit; }
+
+    bool isRunning(int lane) const { return running[lane]; }
+
+    bool any_running() const;
+
+    const uint8_t *get_display(int lane) const { return &display[lane * LOGICAL_WIDTH * LOGICAL_HEIGHT]; }
+
+    bool take_draw_flag(int lane) {
+        bool flag = draw_flag[lane];
+        draw_flag[lane] = false;
+        return flag;
+    }
+
+    uint8_t get_V(int lane, int X) const { return V[X][lane]; }
+
+    uint16_t get_PC(int lane) const { return PC[lane]; }
+
+    uint16_t get_I(int lane) const { return I[lane]; }
+
+    //machine instructions, i.e. one per lane that executed an instruction
+    uint64_t instructions_executed() const { return instruction_count; }
+
+    //decoded instructions that were applied to more than one lane
+    uint64_t lockstep_steps() const { return lockstep_count; }
+
+    //decoded instructions that were applied to a single lane
+    uint64_t single_steps() const { return single_count; }
+
+    //frames that fell back to per lane execution
+    uint64_t divergent_frames() const { return divergent_frame_count; }
+
+private:
+    int lanes;
+    bool increment_I_on_index;
+    double divergence_limit = DEFAULT_DIVERGENCE_LIMIT;
+
+    alignas(32) uint8_t V[REGISTER_COUNT][BATCH_MAX_LANES] = {{0}};
+    alignas(32) uint16_t PC[BATCH_MAX_LANES] = {0};
+    alignas(32) uint16_t I[BATCH_MAX_LANES] = {0};
+    alignas(32) uint16_t stack[STACK_SIZE][BATCH_MAX_LANES] = {{0}};
+    alignas(32) uint8_t SP[BATCH_MAX_LANES] = {0};
+    alignas(32) uint8_t delay[BATCH_MAX_LANES] = {0};
+    alignas(32) uint8_t sound[BATCH_MAX_LANES] = {0};
+
+    alignas(32) uint16_t keys[BATCH_MAX_LANES] = {0};
+    alignas(32) uint16_t prev_keys[BATCH_MAX_LANES] = {0};
+    alignas(32) uint16_t pending_keys[BATCH_MAX_LANES] = {0};
+    alignas(32) uint32_t rng[BATCH_MAX_LANES] = {0};
+
+    bool running[BATCH_MAX_LANES] = {false};
+    bool draw_flag[BATCH_MAX_LANES] = {false};
+    //set when a lane drew this frame, which ends its frame
+    bool frame_drawn[BATCH_MAX_LANES] = {false};
+    int remaining[BATCH_MAX_LANES] = {0};
+
+    //lane l's memory and display start at l * MEMORY_SIZE and l * LOGICAL_WIDTH * LOGICAL_HEIGHT
+    std::vector<uint8_t> memory;
+    std::vector<uint8_t> display;
+
+    //lowest and highest address any lane has written, instructions outside it are identical in every lane
+    int written_low = MEMORY_SIZE;
+    int written_high = -1;
+
+    uint64_t instruction_count = 0;
+    uint64_t lockstep_count = 0;
+    uint64_t single_count = 0;
+    uint64_t divergent_frame_count = 0;
+
+    uint8_t *lane_memory(int lane) { return &memory[lane * MEMORY_SIZE]; }
+
+    bool load_ROM(const std::string &fname);
+
+    uint32_t active_lanes() const;
+
+    //lanes in candidates whose PC and opcode match the given lane
+    uint32_t matching_lanes(uint32_t candidates, int leader, uint16_t opcode) const;
+
+    void execute(uint16_t opcode, uint32_t group);
+
+    void execute_8XY_(uint16_t opcode, const uint8_t *mask, uint32_t group);
+
+    void execute_FX_(uint16_t opcode, const uint8_t *mask, uint32_t group);
+
+    void draw_sprite(int lane, uint8_t X, uint8_t Y, uint8_t N);
+
+    void note_write(int address, int length);
+
+    void stop_lane(int lane) { running[lane] = false; }
+};
+
+
+#endif //CHIP8_BATCH_H
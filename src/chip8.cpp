@@ -3,13 +3,31 @@
 #include <iostream>
 #include <format>
 #include <random>
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <sstream>
 
 
-Chip8::Chip8(std::string fname) {
-    audio.init_audio();
-    running_flag = load_ROM(fname);
+Chip8::Chip8(std::string fname, bool _debug, bool exit, bool increment_I, bool audio_enabled, bool xo_chip)
+        : Chip8State(xo_chip), debug(_debug), exit_on_unknown(exit) {
+    increment_I_on_index = increment_I;
+    if (audio_enabled) {
+        audio.init_audio();
+    }
+    rom_loaded = load_ROM(fname);
     load_instructions();
-    memcpy(memory + FONT_START, FONTSET, sizeof(uint8_t) * FONTSET_SIZE);
+    set_keymap(KEYMAP);
+    reset();
+
+    if (rom_loaded) {
+        native_rom = find_native_rom(rom_image.data(), rom_image.size());
+        set_native_code(!debug);
+        if (native_rom) {
+            native_low = native_rom->code_low;
+            native_high = native_rom->code_high;
+        }
+    }
 }
 
 
@@ -23,18 +41,50 @@ bool Chip8::load_ROM(const std::string &fname) {
     std::streamsize size = file.tellg();
     file.seekg(0, std::ios::beg);
 
-    if (size > MEMORY_SIZE - PROGRAM_START) {
+    if (size > memory_size - PROGRAM_START) {
         std::cerr << "ERROR: Input file is too big\n";
         return false;
     }
 
-    file.read(reinterpret_cast<char *>(&memory[PROGRAM_START]), size);
+    rom_image.resize(size);
+    file.read(reinterpret_cast<char *>(rom_image.data()), size);
 
     return true;
 }
 
 
+void Chip8::reset() {
+    memset(memory, 0, memory_size);
+    memcpy(memory + FONT_START, FONTSET, sizeof(uint8_t) * FONTSET_SIZE);
+    if (!rom_image.empty()) {
+        memcpy(memory + PROGRAM_START, rom_image.data(), rom_image.size());
+    }
+    memset(display, 0, sizeof(uint8_t) * LOGICAL_WIDTH * LOGICAL_HEIGHT);
+
+    PC = PROGRAM_START;
+    I = 0;
+    memset(stack, 0, sizeof(stack));
+    SP = 0;
+    delay = 0;
+    sound = 0;
+    memset(V, 0, sizeof(V));
+    planes = 1;
+    memset(keyboard, 0, sizeof(keyboard));
+    memset(prev_keyboard, 0, sizeof(prev_keyboard));
+    draw_flag = false;
+    running_flag = rom_loaded;
+    native_code_written = false;
+
+    stepping = false;
+    execute_next = false;
+    key_events.clear();
+    next_key_event = 0;
+    idle = false;
+}
+
+
 void Chip8::unknown_opcode(uint16_t opcode) {
+    unknown_count++;
     if (exit_on_unknown) {
         running_flag = false;
     }
@@ -42,13 +92,26 @@ void Chip8::unknown_opcode(uint16_t opcode) {
 }
 
 
+void Chip8::set_memory_profile(MemoryProfile *profile) {
+    mem_profile = profile;
+    if (profile) {
+        use_native = false;
+    }
+}
+
+
+template<bool Profile>
 uint16_t Chip8::fetch() {
-    if (PC > MEMORY_SIZE) {
+    if (PC + 1 >= memory_size) {
         std::cerr << "ERROR: Reached end of instructions\n";
         running_flag = false;
         return 0;
     }
 
+    if constexpr (Profile) {
+        mem_profile->execute(PC, 2);
+    }
+
     uint16_t opcode = memory[PC] << 8 | memory[PC + 1];
     PC += 2;
     return opcode;
@@ -56,9 +119,21 @@ uint16_t Chip8::fetch() {
 
 
 void Chip8::execute_loop() {
+    if (mem_profile) {
+        execute_instruction<true>();
+    } else {
+        execute_instruction<false>();
+    }
+}
+
+
+template<bool Profile>
+void Chip8::execute_instruction() {
     if (running_flag) {
-        uint16_t opcode = fetch();
-        InstructionFunc func = instruction_funcs[(opcode & 0xF000) >> 12];
+        idle = false;
+        uint16_t opcode = fetch<Profile>();
+        instruction_count++;
+        InstructionFunc func = (Profile ? profiled_funcs : instruction_funcs)[(opcode & 0xF000) >> 12];
         if (!func) {
             unknown_opcode(opcode);
         } else {
@@ -72,6 +147,72 @@ void Chip8::execute_loop() {
 }
 
 
+void Chip8::run_frame(int ipf) {
+    //decided once per frame, so the instructions themselves never check whether memory is profiled
+    if (mem_profile) {
+        run_instructions<true>(ipf);
+    } else {
+        run_instructions<false>(ipf);
+    }
+}
+
+
+template<bool Profile>
+void Chip8::run_instructions(int ipf) {
+    //a draw from an earlier frame that has not been presented yet (e.g. while catching up) should not stop this frame
+    bool pending_draw = draw_flag;
+    draw_flag = false;
+
+    uint64_t window = input_window_end - input_window_start;
+    for (int i = 0; i < ipf && running_flag && !draw_flag; ++i) {
+        //apply each key event at the instruction that matches when it happened during the last frame,
+        //so presses and releases within one frame are still seen in order
+        if (next_key_event < key_events.size()) {
+            apply_key_events(input_window_start + window * i / ipf);
+        }
+
+        if (use_native) {
+            //native code runs many instructions per call, so stop it where the next key event has to be applied
+            int limit = ipf;
+            if (next_key_event < key_events.size() && window > 0) {
+                uint64_t timestamp = key_events[next_key_event].timestamp;
+                uint64_t offset = timestamp > input_window_start ? timestamp - input_window_start : 0;
+                limit = static_cast<int>(std::clamp<uint64_t>((offset * ipf + window - 1) / window, i + 1, ipf));
+            }
+
+            int count = native_rom->run(*this, limit - i);
+            if (count > 0) {
+                instruction_count += count;
+                native_count += count;
+                i += count - 1;
+                continue;
+            }
+        }
+
+        execute_instruction<Profile>();
+
+        if (idle && idle_skip) {
+            //nothing the idle loop reads can change before the next key event or the next timer tick,
+            //so account for the instructions it would have run and move on
+            int resume = ipf;
+            if (idle_waits_for_key && next_key_event < key_events.size() && window > 0) {
+                uint64_t timestamp = key_events[next_key_event].timestamp;
+                uint64_t offset = timestamp > input_window_start ? timestamp - input_window_start : 0;
+                resume = static_cast<int>(std::clamp<uint64_t>((offset * ipf + window - 1) / window, i + 1, ipf));
+            }
+
+            int skipped = resume - (i + 1);
+            PC = idle_cycle[skipped % idle_cycle_length];
+            skipped_instructions += skipped;
+            i = resume - 1;
+        }
+    }
+
+    apply_key_events(UINT64_MAX);
+    draw_flag |= pending_draw;
+}
+
+
 void Chip8::opcode_00E_(uint16_t opcode) {
     uint8_t opt = (opcode & 0x00FF);
     if (opt == 0xE0) {
@@ -87,8 +228,7 @@ void Chip8::opcode_00E_(uint16_t opcode) {
 void Chip8::opcode_00E0(uint16_t opcode) {
     if (debug) std::cout << std::format("DEBUG: Called {:04X}: Clear display\n", opcode);
 
-    memset(display, 0, sizeof(uint8_t) * LOGICAL_WIDTH * LOGICAL_HEIGHT);
-    draw_flag = true;
+    clear_display(*this);
 }
 
 
@@ -108,6 +248,11 @@ void Chip8::opcode_1NNN(uint16_t opcode) {
     uint16_t NNN = opcode & 0x0FFF;
     if (debug) std::cout << std::format("DEBUG: Called {:04X}: Jump to {:03X}\n", opcode, NNN);
 
+    //a jump to itself can only be left by a timer or key, and this one reads neither
+    if (NNN == PC - 2) {
+        set_idle({NNN}, false);
+    }
+
     PC = NNN;
 }
 
@@ -121,6 +266,9 @@ void Chip8::opcode_2NNN(uint16_t opcode) {
         running_flag = false;
     } else {
         stack[SP++] = PC;
+        if (SP > stack_high_water) {
+            stack_high_water = SP;
+        }
         PC = NNN;
     }
 }
@@ -135,7 +283,7 @@ void Chip8::opcode_3XNN(uint16_t opcode) {
                                  opcode, X, V[X], NN);
     }
     if (V[X] == NN) {
-        PC += 2;
+        skip_next();
     }
 }
 
@@ -147,24 +295,68 @@ void Chip8::opcode_4XNN(uint16_t opcode) {
                                  opcode, X, V[X], NN);
     }
     if (V[X] != NN) {
-        PC += 2;
+        skip_next();
     }
 }
 
-void Chip8::opcode_5XY0(uint16_t opcode) {
+template<bool Profile>
+void Chip8::opcode_5XY_(uint16_t opcode) {
     uint8_t X = (opcode & 0x0F00) >> 8;
     uint8_t Y = (opcode & 0x00F0) >> 4;
-    if ((opcode & 0x000F) != 0) {
+    uint8_t opt = opcode & 0x000F;
+    if (opt == 0x0) {
+        opcode_5XY0(opcode);
+    } else if (opt == 0x2 && xo_chip) {
+        opcode_5XY2<Profile>(X, Y);
+    } else if (opt == 0x3 && xo_chip) {
+        opcode_5XY3<Profile>(X, Y);
+    } else {
         unknown_opcode(opcode);
-        return;
     }
+}
+
+void Chip8::opcode_5XY0(uint16_t opcode) {
+    uint8_t X = (opcode & 0x0F00) >> 8;
+    uint8_t Y = (opcode & 0x00F0) >> 4;
 
     if (debug) {
         std::cout << std::format("DEBUG: Called {:04X}: Skip next instruction if V{:01X} ({:02X}) = V{:01X} ({:02X})\n",
                                  opcode, X, V[X], Y, V[Y]);
     }
     if (V[X] == V[Y]) {
-        PC += 2;
+        skip_next();
+    }
+}
+
+
+template<bool Profile>
+void Chip8::opcode_5XY2(uint8_t X, uint8_t Y) {
+    if (debug) std::cout << std::format("DEBUG: Called 5{:01X}{:01X}2: Save V{:01X} to V{:01X} into memory[I]\n",
+                                        X, Y, X, Y);
+
+    int count = std::abs(X - Y) + 1;
+    int step = X <= Y ? 1 : -1;
+    if constexpr (Profile) {
+        mem_profile->write(I, count, PC - 2, instruction_count);
+    }
+    note_write(*this, I, count);
+    for (int i = 0; i < count; ++i) {
+        memory[(I + i) & (memory_size - 1)] = V[X + i * step];
+    }
+}
+
+template<bool Profile>
+void Chip8::opcode_5XY3(uint8_t X, uint8_t Y) {
+    if (debug) std::cout << std::format("DEBUG: Called 5{:01X}{:01X}3: Load V{:01X} to V{:01X} from memory[I]\n",
+                                        X, Y, X, Y);
+
+    int count = std::abs(X - Y) + 1;
+    int step = X <= Y ? 1 : -1;
+    if constexpr (Profile) {
+        mem_profile->read(I, count);
+    }
+    for (int i = 0; i < count; ++i) {
+        V[X + i * step] = memory[(I + i) & (memory_size - 1)];
     }
 }
 
@@ -197,61 +389,60 @@ void Chip8::opcode_8XY_(uint16_t opcode) {
     bool flag = false;
     switch (opt) {
         case 0x0: //Set VX = VY
-            debug_str = std::format("DEBUG: Called {:04X}: Set V{:01X} = V{:01X}\n", opcode, X, Y);
+            if (debug) debug_str = std::format("DEBUG: Called {:04X}: Set V{:01X} = V{:01X}\n", opcode, X, Y);
             V[X] = V[Y];
             break;
         case 0x1: //Set VX = VX | VY
-            debug_str = std::format("DEBUG: Called {:04X}: Set V{:01X} |= V{:01X}\n", opcode, X, Y);
+            if (debug) debug_str = std::format("DEBUG: Called {:04X}: Set V{:01X} |= V{:01X}\n", opcode, X, Y);
             V[X] |= V[Y];
             V[0xF] = 0;
             break;
         case 0x2: //Set VX = VX & VY
-            debug_str = std::format("DEBUG: Called {:04X}: Set V{:01X} &= V{:01X}\n", opcode, X, Y);
+            if (debug) debug_str = std::format("DEBUG: Called {:04X}: Set V{:01X} &= V{:01X}\n", opcode, X, Y);
             V[X] &= V[Y];
             V[0xF] = 0;
             break;
         case 0x3: //Set VX = VX ^ VY
-            debug_str = std::format("DEBUG: Called {:04X}: Set V{:01X} ^= V{:01X}\n", opcode, X, Y);
+            if (debug) debug_str = std::format("DEBUG: Called {:04X}: Set V{:01X} ^= V{:01X}\n", opcode, X, Y);
             V[X] ^= V[Y];
             V[0xF] = 0;
             break;
         case 0x4: //Set VX = VX + VY and set VF = 1 if overflow
-            debug_str = std::format("DEBUG: Called {:04X}: Set V{:01X} += V{:01X}\n", opcode, X, Y);
+            if (debug) debug_str = std::format("DEBUG: Called {:04X}: Set V{:01X} += V{:01X}\n", opcode, X, Y);
             flag = (V[X] + V[Y]) > 255;
             V[X] += V[Y];
             V[0xF] = flag;
             break;
         case 0x5: //Set VX = VX - VY and set VF = 1 if VX > VY
-            debug_str = std::format("DEBUG: Called {:04X}: Set V{:01X} -= V{:01X}\n", opcode, X, Y);
+            if (debug) debug_str = std::format("DEBUG: Called {:04X}: Set V{:01X} -= V{:01X}\n", opcode, X, Y);
             flag = V[X] >= V[Y];
             V[X] -= V[Y];
             V[0xF] = flag;
             break;
         case 0x6: //Set VX = VY, shift VX 1 bit right and set VF = the shifted out bit
-            debug_str = std::format("DEBUG: Called {:04X}: Set V{:01X} = V{:01X} >> 1,\n", opcode, X, Y);
+            if (debug) debug_str = std::format("DEBUG: Called {:04X}: Set V{:01X} = V{:01X} >> 1,\n", opcode, X, Y);
             V[X] = V[Y];
             flag = V[X] & 1;
             V[X] >>= 1;
             V[0xF] = flag;
             break;
         case 0x7: //Set VX = VY - VX and set VF = 1 if VY > VX
-            debug_str = std::format("DEBUG: Called {:04X}: Set V{:01X} = V{:01X} - V{:01X}\n", opcode, X, Y, X);
+            if (debug) {
+                debug_str = std::format("DEBUG: Called {:04X}: Set V{:01X} = V{:01X} - V{:01X}\n", opcode, X, Y, X);
+            }
             flag = V[Y] >= V[X];
             V[X] = V[Y] - V[X];
             V[0xF] = flag;
             break;
         case 0xE: //Set VX = VY, shift VX 1 bit left and set VF = the shifted out bit
-            debug_str = std::format("DEBUG: Called {:04X}: Set V{:01X} = V{:01X} << 1\n", opcode, X, Y);
+            if (debug) debug_str = std::format("DEBUG: Called {:04X}: Set V{:01X} = V{:01X} << 1\n", opcode, X, Y);
             V[X] = V[Y];
             flag = (V[X] & 10000000) >> 7;
             V[X] <<= 1;
             V[0xF] = flag;
             break;
         default:
-            if (exit_on_unknown) {
-                running_flag = false;
-            }
-            std::cerr << std::format("ERROR: Unknown opcode: {:04X}\n", opcode);
+            unknown_opcode(opcode);
     }
     if (debug && !debug_str.empty()) {
         std::cout << debug_str;
@@ -273,7 +464,7 @@ void Chip8::opcode_9XY0(uint16_t opcode) {
                 opcode, X, V[X], Y, V[Y]);
 
     if (V[X] != V[Y]) {
-        PC += 2;
+        skip_next();
     }
 }
 
@@ -292,17 +483,16 @@ void Chip8::opcode_BNNN(uint16_t opcode) {
 }
 
 void Chip8::opcode_CXNN(uint16_t opcode) {
-    static std::random_device rd;
-    static std::mt19937 gen{rd()};
-    static std::uniform_int_distribution<uint8_t> dis;
+    std::uniform_int_distribution<int> dis(0, 255);
 
     uint8_t X = (opcode & 0x0F00) >> 8;
     uint8_t NN = opcode & 0x00FF;
 
     if (debug) std::cout << std::format("DEBUG: Called {:04X} V[{:01X}] = RAND & {:02X}\n", opcode, X, NN);
-    V[X] = dis(gen) & NN;
+    V[X] = dis(rng) & NN;
 }
 
+template<bool Profile>
 void Chip8::opcode_DXYN(uint16_t opcode) {
     if (debug) std::cout << std::format("DEBUG: Called {:04X}: Draw\n", opcode);
 
@@ -310,37 +500,12 @@ void Chip8::opcode_DXYN(uint16_t opcode) {
     uint8_t Y = (opcode & 0x00F0) >> 4;
     uint8_t N = opcode & 0x000F;
 
-    uint8_t x = V[X] % LOGICAL_WIDTH;
-    uint8_t y = V[Y] % LOGICAL_HEIGHT;
-    uint8_t pixel;
-
-    V[0xF] = 0;
-
-    //for all N rows:
-    for (uint8_t y_coord = 0; y_coord < N; ++y_coord) {
-        //get the pixel data for that row
-        pixel = memory[I + y_coord];
-        //for each bit
-        for (uint8_t x_coord = 0; x_coord < 8; ++x_coord) {
-            //if the pixel in the sprite is on
-            if ((pixel & (0x80 >> x_coord)) != 0) {
-                //do not clip if we go over, instead skip to the next row
-                if (x + x_coord >= LOGICAL_WIDTH || y + y_coord >= LOGICAL_HEIGHT) {
-                    continue;
-                }
-
-                //set the pixel value in display by XORing it with the pixel value (1)
-                //if this causes a pixel to be erased, set VF = 1
-                if (display[x + x_coord + ((y + y_coord) * LOGICAL_WIDTH)]) {
-                    V[0xF] = 1;
-                }
-
-                display[x + x_coord + ((y + y_coord) * LOGICAL_WIDTH)] ^= 1;
-            }
-        }
+    if constexpr (Profile) {
+        //one sprite per selected plane, XO-CHIP's DXY0 is 16 rows of 2 bytes
+        int length = xo_chip && N == 0 ? 32 : N;
+        mem_profile->read(I, length * std::popcount(planes));
     }
-
-    draw_flag = true;
+    draw_sprite(*this, X, Y, N);
 }
 
 void Chip8::opcode_EX_(uint16_t opcode) {
@@ -363,8 +528,9 @@ void Chip8::opcode_EX9E(uint8_t X) {
     if (debug) std::cout << std::format("DEBUG: Called E{:01X}9E Skip if key in V{:01X} is pressed\n", X, X);
 
     uint8_t key = V[X];
+    observe_key(key);
     if (keyboard[key]) {
-        PC += 2;
+        skip_next();
     }
 }
 
@@ -372,17 +538,33 @@ void Chip8::opcode_EXA1(uint8_t X) {
     if (debug) std::cout << std::format("DEBUG: Called E{:01X}9E Skip if key in V{:01X} is not pressed\n", X, X);
 
     uint8_t key = V[X];
+    observe_key(key);
     if (!keyboard[key]) {
-        PC += 2;
+        skip_next();
     }
 }
 
 
+template<bool Profile>
 void Chip8::opcode_FX_(uint16_t opcode) {
     uint8_t X = (opcode & 0x0F00) >> 8;
     uint8_t opt = (opcode & 0x00FF);
 
     switch (opt) {
+        case 0x00:
+            if (xo_chip && X == 0) {
+                opcode_F000<Profile>();
+            } else {
+                unknown_opcode(opcode);
+            }
+            break;
+        case 0x01:
+            if (xo_chip) {
+                opcode_FN01(X);
+            } else {
+                unknown_opcode(opcode);
+            }
+            break;
         case 0x07:
             opcode_FX07(X);
             break;
@@ -402,13 +584,13 @@ void Chip8::opcode_FX_(uint16_t opcode) {
             opcode_FX29(X);
             break;
         case 0x33:
-            opcode_FX33(X);
+            opcode_FX33<Profile>(X);
             break;
         case 0x55:
-            opcode_FX55(X);
+            opcode_FX55<Profile>(X);
             break;
         case 0x65:
-            opcode_FX65(X);
+            opcode_FX65<Profile>(X);
             break;
         default:
             unknown_opcode(opcode);
@@ -416,9 +598,41 @@ void Chip8::opcode_FX_(uint16_t opcode) {
 
 }
 
+template<bool Profile>
+void Chip8::opcode_F000() {
+    uint16_t NNNN = memory[PC & (memory_size - 1)] << 8 | memory[(PC + 1) & (memory_size - 1)];
+    if (debug) std::cout << std::format("DEBUG: Called F000: Set I = {:04X}\n", NNNN);
+    if constexpr (Profile) {
+        mem_profile->execute(PC, 2);
+    }
+
+    I = NNNN;
+    PC += 2;
+}
+
+void Chip8::opcode_FN01(uint8_t N) {
+    if (debug) std::cout << std::format("DEBUG: Called F{:01X}01: Select planes {:01X}\n", N, N);
+    planes = N & ((1 << PLANE_COUNT) - 1);
+}
+
 void Chip8::opcode_FX07(uint8_t X) {
     if (debug) std::cout << std::format("DEBUG: Called F{:01X}07: Set V{:01X} = delay\n", X, X);
     V[X] = delay;
+
+    //FX07, 3XNN/4XNN, 1NNN back to the FX07 busy waits on the delay timer. If the skip will not be taken
+    //the loop cannot exit before the timer changes, which only happens at the next frame
+    uint16_t start = PC - 2;
+    if (PC + 3 < memory_size) {
+        uint16_t skip = memory[PC] << 8 | memory[PC + 1];
+        uint16_t jump = memory[PC + 2] << 8 | memory[PC + 3];
+        bool same_register = ((skip & 0x0F00) >> 8) == X;
+        uint8_t NN = skip & 0x00FF;
+
+        if (jump == (0x1000 | start) && same_register &&
+            (((skip & 0xF000) == 0x3000 && V[X] != NN) || ((skip & 0xF000) == 0x4000 && V[X] == NN))) {
+            set_idle({PC, static_cast<uint16_t>(PC + 2), start}, false);
+        }
+    }
 }
 
 void Chip8::opcode_FX0A(uint8_t X) {
@@ -426,12 +640,14 @@ void Chip8::opcode_FX0A(uint8_t X) {
 
     for (int i = 0; i < KEY_COUNT; ++i) {
         if (!keyboard[i] && prev_keyboard[i]) {
+            observe_key(i);
             V[X] = i;
             return;
         }
     }
 
     PC -= 2;
+    set_idle({PC}, true);
 }
 
 void Chip8::opcode_FX15(uint8_t X) {
@@ -457,29 +673,43 @@ void Chip8::opcode_FX29(uint8_t X) {
 }
 
 
+template<bool Profile>
 void Chip8::opcode_FX33(uint8_t X) {
     if (debug) std::cout << std::format("DEBUG: Called F{:01X}33: Compute BCD of V{:01X}\n", X, X);
 
+    if constexpr (Profile) {
+        mem_profile->write(I, 3, PC - 2, instruction_count);
+    }
+    note_write(*this, I, 3);
     uint8_t val = V[X];
     for (int i = 2; i >= 0; --i) {
-        memory[I + i] = val % 10;
+        memory[(I + i) & (memory_size - 1)] = val % 10;
         val /= 10;
     }
 }
 
+template<bool Profile>
 void Chip8::opcode_FX55(uint8_t X) {
     if (debug) std::cout << std::format("DEBUG: Called F{:01X}55: Load registers V0 to V{:01X} into memory[I]\n", X, X);
-    memcpy(&memory[I], V, (X + 1) * sizeof(uint8_t));
+    if constexpr (Profile) {
+        mem_profile->write(I, X + 1, PC - 2, instruction_count);
+    }
+    note_write(*this, I, X + 1);
+    store_memory(*this, I, V, X + 1);
     if (increment_I_on_index) I += X + 1;
 }
 
+template<bool Profile>
 void Chip8::opcode_FX65(uint8_t X) {
     if (debug) {
         std::cout << std::format("DEBUG: Called F{:01X}55: Load memory[I] into registers V[0] to V{:01X} \n",
                                  X, X);
     }
 
-    memcpy(V, &memory[I], (X + 1) * sizeof(uint8_t));
+    if constexpr (Profile) {
+        mem_profile->read(I, X + 1);
+    }
+    load_memory(*this, I, V, X + 1);
     if (increment_I_on_index) I += X + 1;
 }
 
@@ -489,7 +719,7 @@ void Chip8::load_instructions() {
     instruction_funcs[0x2] = &Chip8::opcode_2NNN;
     instruction_funcs[0x3] = &Chip8::opcode_3XNN;
     instruction_funcs[0x4] = &Chip8::opcode_4XNN;
-    instruction_funcs[0x5] = &Chip8::opcode_5XY0;
+    instruction_funcs[0x5] = &Chip8::opcode_5XY_<false>;
     instruction_funcs[0x6] = &Chip8::opcode_6XNN;
     instruction_funcs[0x7] = &Chip8::opcode_7XNN;
     instruction_funcs[0x8] = &Chip8::opcode_8XY_;
@@ -497,13 +727,18 @@ void Chip8::load_instructions() {
     instruction_funcs[0xA] = &Chip8::opcode_ANNN;
     instruction_funcs[0xB] = &Chip8::opcode_BNNN;
     instruction_funcs[0xC] = &Chip8::opcode_CXNN;
-    instruction_funcs[0xD] = &Chip8::opcode_DXYN;
+    instruction_funcs[0xD] = &Chip8::opcode_DXYN<false>;
     instruction_funcs[0xE] = &Chip8::opcode_EX_;
-    instruction_funcs[0xF] = &Chip8::opcode_FX_;
+    instruction_funcs[0xF] = &Chip8::opcode_FX_<false>;
+
+    std::copy(std::begin(instruction_funcs), std::end(instruction_funcs), profiled_funcs);
+    profiled_funcs[0x5] = &Chip8::opcode_5XY_<true>;
+    profiled_funcs[0xD] = &Chip8::opcode_DXYN<true>;
+    profiled_funcs[0xF] = &Chip8::opcode_FX_<true>;
 }
 
 void Chip8::draw(Screen &screen) {
-    if (draw_flag) {
+    if (draw_flag || screen.is_animating()) {
         screen.draw(display);
         draw_flag = false;
     }
@@ -512,15 +747,17 @@ void Chip8::draw(Screen &screen) {
 void Chip8::update_inputs() {
     SDL_Event e;
     memcpy(prev_keyboard, keyboard, sizeof(bool) * KEY_COUNT);
+    input_window_start = input_window_end;
+    input_window_end = SDL_GetTicksNS();
+
     while (SDL_PollEvent(&e)) {
         if (e.type == SDL_EVENT_QUIT) {
             running_flag = false;
             break;
         } else if (e.type == SDL_EVENT_KEY_DOWN) {
-            for (int i = 0; i < KEY_COUNT; i++) {
-                if (e.key.scancode == KEYMAP[i]) {
-                    keyboard[i] = true;
-                }
+            int8_t key = scancode_keys[e.key.scancode];
+            if (key >= 0 && !e.key.repeat) {
+                key_events.push_back({e.key.timestamp, static_cast<uint8_t>(key), true});
             }
         } else if (e.type == SDL_EVENT_KEY_UP) {
             if (e.key.scancode == EXIT_BUTTON) {
@@ -539,13 +776,128 @@ void Chip8::update_inputs() {
                 execute_next = true;
             }
 
-            for (int i = 0; i < KEY_COUNT; i++) {
-                if (e.key.scancode == KEYMAP[i]) {
-                    keyboard[i] = false;
-                }
+            int8_t key = scancode_keys[e.key.scancode];
+            if (key >= 0) {
+                key_events.push_back({e.key.timestamp, static_cast<uint8_t>(key), false});
             }
         }
     }
+
+    //when stepping there is no frame to spread the events over
+    if (!timestamped_input || stepping) {
+        apply_key_events(UINT64_MAX);
+    }
+}
+
+void Chip8::skip_next() {
+    if (xo_chip && PC + 1 < memory_size && memory[PC] == 0xF0 && memory[PC + 1] == 0x00) {
+        PC += 4;
+    } else {
+        PC += 2;
+    }
+}
+
+void Chip8::set_idle(std::initializer_list<uint16_t> cycle, bool waits_for_key) {
+    idle = true;
+    idle_waits_for_key = waits_for_key;
+    idle_cycle_length = 0;
+    for (uint16_t address: cycle) {
+        idle_cycle[idle_cycle_length++] = address;
+    }
+}
+
+void Chip8::apply_key_events(uint64_t until) {
+    while (next_key_event < key_events.size() && key_events[next_key_event].timestamp <= until) {
+        const KeyEvent &event = key_events[next_key_event++];
+        keyboard[event.key] = event.down;
+        if (event.down) {
+            prev_keyboard[event.key] = true;
+        }
+        key_change_time[event.key] = event.timestamp;
+        key_unobserved[event.key] = true;
+    }
+
+    if (next_key_event == key_events.size()) {
+        key_events.clear();
+        next_key_event = 0;
+    }
+}
+
+void Chip8::observe_key(uint8_t key) {
+    if (key < KEY_COUNT && key_unobserved[key]) {
+        key_unobserved[key] = false;
+        latency_hist.record(std::chrono::nanoseconds(SDL_GetTicksNS() - key_change_time[key]));
+    }
+}
+
+void Chip8::set_keys(uint16_t pressed) {
+    //the same as polling once with these keys held, so FX0A sees a key that was released since the last call
+    memcpy(prev_keyboard, keyboard, sizeof(bool) * KEY_COUNT);
+    for (int i = 0; i < KEY_COUNT; ++i) {
+        keyboard[i] = (pressed >> i) & 1;
+        if (keyboard[i]) {
+            prev_keyboard[i] = true;
+        }
+    }
+}
+
+void Chip8::bind_display(uint8_t *buffer) {
+    if (!buffer) {
+        buffer = own_display;
+    }
+    if (buffer != display) {
+        memcpy(buffer, display, sizeof(uint8_t) * LOGICAL_WIDTH * LOGICAL_HEIGHT);
+        display = buffer;
+    }
+}
+
+void Chip8::set_keymap(const SDL_Scancode keymap[KEY_COUNT]) {
+    memset(scancode_keys, -1, sizeof(scancode_keys));
+    for (int i = 0; i < KEY_COUNT; ++i) {
+        scancode_keys[keymap[i]] = static_cast<int8_t>(i);
+    }
+}
+
+void Chip8::remap_key(uint8_t key, SDL_Scancode scancode) {
+    if (key >= KEY_COUNT || scancode <= SDL_SCANCODE_UNKNOWN || scancode >= SDL_SCANCODE_COUNT) {
+        return;
+    }
+
+    //a scancode can only drive one key, and each key only has one scancode
+    for (int8_t &mapped: scancode_keys) {
+        if (mapped == key) mapped = -1;
+    }
+    scancode_keys[scancode] = static_cast<int8_t>(key);
+}
+
+bool parse_keymap(const std::string &str, SDL_Scancode keymap[KEY_COUNT]) {
+    std::vector<std::string> names;
+    if (str.find(',') == std::string::npos) {
+        for (char c: str) {
+            names.emplace_back(1, c);
+        }
+    } else {
+        std::stringstream ss(str);
+        std::string name;
+        while (std::getline(ss, name, ',')) {
+            names.push_back(name);
+        }
+    }
+
+    if (names.size() != KEY_COUNT) {
+        return false;
+    }
+
+    SDL_Scancode parsed[KEY_COUNT];
+    for (int i = 0; i < KEY_COUNT; ++i) {
+        parsed[i] = SDL_GetScancodeFromName(names[i].c_str());
+        if (parsed[i] == SDL_SCANCODE_UNKNOWN) {
+            return false;
+        }
+    }
+
+    memcpy(keymap, parsed, sizeof(parsed));
+    return true;
 }
 
 void Chip8::decrement_timers() {
@@ -2,77 +2,62 @@
 #define CHIP_8_CHIP8_H
 
 #include <SDL3/SDL.h>
+#include <random>
 #include <string>
+#include <vector>
 #include "screen.h"
 #include "audio.h"
-
-const int KEY_COUNT = 16;
-const int REGISTER_COUNT = 16;
-const int MEMORY_SIZE = 4096;
-const int STACK_SIZE = 16;
-
-const int LOGICAL_WIDTH = 64;
-const int LOGICAL_HEIGHT = 32;
+#include "frame_pacer.h"
+#include "chip8_state.h"
+#include "native.h"
+#include "mem_profile.h"
 
 const int EXIT_BUTTON = SDL_SCANCODE_ESCAPE;
 
 const int PAUSE_BUTTON = SDL_SCANCODE_SPACE;
 const int STEP_BUTTON = SDL_SCANCODE_RIGHT;
 
-const int PROGRAM_START = 0x200;
-const int FONT_START = 0x050;
-
-const int FONTSET_SIZE = 80;
-
-constexpr uint8_t FONTSET[FONTSET_SIZE] = {
-        0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-        0x20, 0x60, 0x20, 0x20, 0x70, // 1
-        0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-        0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-        0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-        0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-        0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-        0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-        0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-        0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-        0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-        0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-        0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-        0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-        0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-        0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-};
-
-constexpr uint8_t KEYMAP[KEY_COUNT] = {
+constexpr SDL_Scancode KEYMAP[KEY_COUNT] = {
         SDL_SCANCODE_X, SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3,
         SDL_SCANCODE_Q, SDL_SCANCODE_W, SDL_SCANCODE_E, SDL_SCANCODE_A,
         SDL_SCANCODE_S, SDL_SCANCODE_D, SDL_SCANCODE_Z, SDL_SCANCODE_C,
         SDL_SCANCODE_4, SDL_SCANCODE_R, SDL_SCANCODE_F, SDL_SCANCODE_V
 };
 
-class Chip8 {
+//parses either 16 single character key names ("x123qweasdzc4rfv") or 16 comma separated SDL key names,
+//in keypad order 0 to F
+bool parse_keymap(const std::string &str, SDL_Scancode keymap[KEY_COUNT]);
+
+struct KeyEvent {
+    //SDL event timestamp in nanoseconds
+    uint64_t timestamp;
+    uint8_t key;
+    bool down;
+};
+
+//the machine state lives in Chip8State so native code generated by chip8-aot can run on it directly
+class Chip8 : private Chip8State {
 public:
-    explicit Chip8(std::string fname);
+    explicit Chip8(std::string fname) : Chip8(fname, true, true, false, true) {}
 
-    Chip8(std::string _fname, bool _debug) : Chip8(_fname) {
-        debug = _debug;
-    }
+    Chip8(std::string _fname, bool _debug) : Chip8(_fname, _debug, true, false, true) {}
 
-    Chip8(std::string _fname, bool _debug, bool exit) : Chip8(_fname) {
-        debug = _debug;
-        exit_on_unknown = exit;
-    }
+    Chip8(std::string _fname, bool _debug, bool exit) : Chip8(_fname, _debug, exit, false, true) {}
 
-    Chip8(std::string _fname, bool _debug, bool exit, bool increment_I) : Chip8(_fname, _debug, exit) {
-        debug = _debug;
-        exit_on_unknown = exit;
-        increment_I_on_index = increment_I;
-    }
+    Chip8(std::string _fname, bool _debug, bool exit, bool increment_I) : Chip8(_fname, _debug, exit, increment_I, true) {}
 
+    //audio_enabled is false for instances that should not open the audio device, e.g. when running many at once
+    Chip8(std::string _fname, bool _debug, bool exit, bool increment_I, bool audio_enabled)
+            : Chip8(_fname, _debug, exit, increment_I, audio_enabled, false) {}
 
+    //xo_chip enables the XO-CHIP extensions and 64 KB of memory
+    Chip8(std::string fname, bool _debug, bool exit, bool increment_I, bool audio_enabled, bool xo_chip);
 
     void execute_loop();
 
+    //runs up to ipf instructions, stopping early after a draw to emulate waiting for the vertical blank
+    void run_frame(int ipf);
+
     void update_inputs();
 
     void decrement_timers();
@@ -87,6 +72,79 @@ public:
 
     bool is_draw_flag() const {return draw_flag;}
 
+    //returns whether the display changed since the last call, for callers that present the display themselves
+    bool take_draw_flag() {
+        bool flag = draw_flag;
+        draw_flag = false;
+        return flag;
+    }
+
+    const uint8_t *get_display() const { return display; }
+
+    //4 KB, or 64 KB for XO-CHIP
+    int get_memory_size() const { return memory_size; }
+
+    //draws into buffer instead of the display owned by this instance, copying the current display over.
+    //buffer holds LOGICAL_WIDTH * LOGICAL_HEIGHT bytes and has to stay valid until it is unbound again,
+    //nullptr switches back to the owned display
+    void bind_display(uint8_t *buffer);
+
+    uint8_t peek(uint16_t address) const { return memory[address & (memory_size - 1)]; }
+
+    bool is_xo_chip() const { return xo_chip; }
+
+    //restarts the ROM from a clean machine state, keeping the settings and statistics of this instance
+    void reset();
+
+    //sets the held keys directly instead of polling SDL, bit i is key i
+    void set_keys(uint16_t pressed);
+
+    uint64_t instructions_executed() const { return instruction_count; }
+
+    //instructions that idle loops would have run but were skipped
+    uint64_t instructions_skipped() const { return skipped_instructions; }
+
+    //emulated instruction cycles, counting skipped idle instructions as if they had run
+    uint64_t cycles_elapsed() const { return instruction_count + skipped_instructions; }
+
+    void set_idle_skip(bool enabled) { idle_skip = enabled; }
+
+    //true if chip8-aot translated this ROM and the translation was linked in
+    bool has_native_code() const { return native_rom != nullptr; }
+
+    //native code is used by default when available, except in debug mode which traces every instruction
+    //and while memory is profiled
+    void set_native_code(bool enabled) { use_native = enabled && native_rom && !mem_profile; }
+
+    //instructions run by native code, included in instructions_executed()
+    uint64_t native_instructions() const { return native_count; }
+
+    //counts every memory access into profile, which has to stay valid until nullptr is set again. The counting
+    //is done by a separately compiled variant of the interpreter, so it costs nothing while no profile is set.
+    //Native code is turned off, since its accesses can not be counted
+    void set_memory_profile(MemoryProfile *profile);
+
+    //for reproducible runs, e.g. when comparing against native code
+    void seed_random(uint32_t seed) { rng.seed(seed); }
+
+    void set_keymap(const SDL_Scancode keymap[KEY_COUNT]);
+
+    void remap_key(uint8_t key, SDL_Scancode scancode);
+
+    //if enabled, key events are replayed at the instruction of the next frame matching when they happened instead of
+    //being applied as soon as they are polled. This keeps their order within a frame, at up to one frame of latency
+    void set_timestamped_input(bool enabled) { timestamped_input = enabled; }
+
+    uint64_t unknown_opcodes() const { return unknown_count; }
+
+    //deepest the call stack has been
+    int stack_depth_high_water() const { return stack_high_water; }
+
+    uint64_t audio_underruns() const { return audio.underrun_count(); }
+
+    //time from a key event to the first instruction that reads that key
+    const FrameHistogram &input_latency() const { return latency_hist; }
+
 private:
     Audio audio;
 
@@ -94,40 +152,76 @@ private:
     bool stepping = false;
     bool execute_next = false;
     bool exit_on_unknown = true;
-    bool increment_I_on_index = false;
 
-    uint8_t memory[MEMORY_SIZE] = {0};
+    //SDL_SCANCODE_COUNT entries, -1 for scancodes that are not mapped to a key
+    int8_t scancode_keys[SDL_SCANCODE_COUNT];
 
-    uint8_t display[LOGICAL_WIDTH * LOGICAL_HEIGHT] = {0};
-    uint16_t PC = PROGRAM_START;
-    uint16_t I = 0;
+    bool timestamped_input = false;
+    std::vector<KeyEvent> key_events;
+    size_t next_key_event = 0;
+    //real time covered by the events from the last poll, spread over the instructions of the next frame
+    uint64_t input_window_start = 0;
+    uint64_t input_window_end = 0;
 
-    uint16_t stack[STACK_SIZE] = {0};
-    uint16_t SP = 0;
+    uint64_t key_change_time[KEY_COUNT] = {0};
+    bool key_unobserved[KEY_COUNT] = {false};
+    FrameHistogram latency_hist;
 
-    uint8_t delay = 0;
-    uint8_t sound = 0;
+    uint64_t instruction_count = 0;
+    uint64_t unknown_count = 0;
 
-    uint8_t V[REGISTER_COUNT] = {0};
+    //set by instructions that detect the program is spinning until a timer tick or key event.
+    //idle_cycle holds the addresses PC cycles through from here on, so PC can be placed where the loop would be
+    bool idle_skip = true;
+    bool idle = false;
+    bool idle_waits_for_key = false;
+    uint16_t idle_cycle[3] = {0};
+    int idle_cycle_length = 0;
+    uint64_t skipped_instructions = 0;
 
-    bool keyboard[KEY_COUNT] = {false};
-    bool prev_keyboard[KEY_COUNT] = {false};
+    bool rom_loaded = false;
+    std::vector<uint8_t> rom_image;
 
-    bool draw_flag = false;
+    const NativeROM *native_rom = nullptr;
+    bool use_native = false;
+    uint64_t native_count = 0;
 
-    bool running_flag;
+    //each instance has its own generator so instances on different threads do not share state
+    std::mt19937 rng{std::random_device{}()};
+
+    MemoryProfile *mem_profile = nullptr;
 
     using InstructionFunc = void (Chip8::*)(uint16_t);
     InstructionFunc instruction_funcs[16] = {nullptr};
+    //the same with the instructions that access memory replaced by their profiling variants
+    InstructionFunc profiled_funcs[16] = {nullptr};
 
     bool load_ROM(const std::string &fname);
 
     void load_instructions();
 
+    //the Profile variants count memory accesses into mem_profile
+    template<bool Profile>
     uint16_t fetch();
 
+    template<bool Profile>
+    void execute_instruction();
+
+    template<bool Profile>
+    void run_instructions(int ipf);
+
     void unknown_opcode(uint16_t opcode);
 
+    //applies all queued key events up to the given timestamp
+    void apply_key_events(uint64_t until);
+
+    void observe_key(uint8_t key);
+
+    void set_idle(std::initializer_list<uint16_t> cycle, bool waits_for_key);
+
+    //skips the next instruction, which is 4 bytes long if it is XO-CHIP's F000 NNNN
+    void skip_next();
+
     //00E_ Either 00E0 or 00EE
     void opcode_00E_(uint16_t opcode);
 
@@ -149,9 +243,21 @@ private:
     //4XNN Skip next instruction if VX != NN
     void opcode_4XNN(uint16_t opcode);
 
+    //5XY_ Either 5XY0, 5XY2 or 5XY3
+    template<bool Profile>
+    void opcode_5XY_(uint16_t opcode);
+
     //5XY0 Skip next instruction if VX = VY
     void opcode_5XY0(uint16_t opcode);
 
+    //5XY2 Save VX to VY in memory[I], in either order (XO-CHIP)
+    template<bool Profile>
+    void opcode_5XY2(uint8_t X, uint8_t Y);
+
+    //5XY3 Load VX to VY from memory[I], in either order (XO-CHIP)
+    template<bool Profile>
+    void opcode_5XY3(uint8_t X, uint8_t Y);
+
     //6XNN Let VX = NN
     void opcode_6XNN(uint16_t opcode);
 
@@ -174,6 +280,7 @@ private:
     void opcode_CXNN(uint16_t opcode);
 
     //DXYN Draw
+    template<bool Profile>
     void opcode_DXYN(uint16_t opcode);
 
     void opcode_EX_(uint16_t opcode);
@@ -182,8 +289,16 @@ private:
 
     void opcode_EXA1(uint8_t X);
 
+    template<bool Profile>
     void opcode_FX_(uint16_t opcode);
 
+    //F000 NNNN Let I = NNNN, the address is the next 2 bytes (XO-CHIP)
+    template<bool Profile>
+    void opcode_F000();
+
+    //FN01 Select the planes in N for drawing and clearing (XO-CHIP)
+    void opcode_FN01(uint8_t N);
+
     //FX07 Let VX = delay timer
     void opcode_FX07(uint8_t X);
 
@@ -203,12 +318,15 @@ private:
     void opcode_FX29(uint8_t X);
 
     //FX33 Convert VX to BCD and store starting at memory[I]
+    template<bool Profile>
     void opcode_FX33(uint8_t X);
 
     //FX55 Store memory
+    template<bool Profile>
     void opcode_FX55(uint8_t X);
 
     //FX65 Load memory
+    template<bool Profile>
     void opcode_FX65(uint8_t X);
 };
 
@@ -0,0 +1,58 @@
+#include "chip8_env.h"
+#include <cstring>
+#include "environment.h"
+
+struct chip8_env {
+    VectorEnv env;
+};
+
+chip8_env *chip8_env_create(const char *rom, int count, int threads, int ipf) {
+    auto *handle = new chip8_env{VectorEnv(rom, count, threads, true, ipf)};
+    if (!handle->env.is_loaded()) {
+        delete handle;
+        return nullptr;
+    }
+    return handle;
+}
+
+void chip8_env_destroy(chip8_env *env) {
+    delete env;
+}
+
+int chip8_env_size(const chip8_env *env) {
+    return env->env.size();
+}
+
+int chip8_env_observation_size(void) {
+    return OBSERVATION_SIZE;
+}
+
+void chip8_env_add_reward_hook(chip8_env *env, uint16_t address, int length, int bcd, float scale) {
+    env->env.add_reward_hook({address, length, bcd != 0, scale});
+}
+
+void chip8_env_add_done_hook(chip8_env *env, uint16_t address, uint8_t value) {
+    env->env.add_done_hook({address, value});
+}
+
+void chip8_env_set_observation_buffer(chip8_env *env, uint8_t *buffer) {
+    env->env.set_observation_buffer(buffer);
+}
+
+void chip8_env_reset(chip8_env *env, uint32_t seed) {
+    env->env.reset(seed);
+}
+
+void chip8_env_step(chip8_env *env, const uint16_t *actions, int frames_per_step, float *rewards, uint8_t *dones) {
+    env->env.step(actions, frames_per_step);
+    if (rewards) {
+        memcpy(rewards, env->env.rewards(), sizeof(float) * env->env.size());
+    }
+    if (dones) {
+        memcpy(dones, env->env.dones(), sizeof(uint8_t) * env->env.size());
+    }
+}
+
+const uint8_t *chip8_env_observations(const chip8_env *env) {
+    return env->env.observations();
+}
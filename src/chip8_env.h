@@ -0,0 +1,43 @@
+#ifndef CHIP8_CHIP8_ENV_H
+#define CHIP8_CHIP8_ENV_H
+
+/* C interface to VectorEnv, for binding from other languages (e.g. Python ctypes) */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct chip8_env chip8_env;
+
+/* returns NULL if the ROM could not be loaded. threads <= 0 uses one thread per core */
+chip8_env *chip8_env_create(const char *rom, int count, int threads, int ipf);
+
+void chip8_env_destroy(chip8_env *env);
+
+int chip8_env_size(const chip8_env *env);
+
+/* bytes per observation, observations are size() of these back to back */
+int chip8_env_observation_size(void);
+
+/* reward hooks count from the next reset on */
+void chip8_env_add_reward_hook(chip8_env *env, uint16_t address, int length, int bcd, float scale);
+
+void chip8_env_add_done_hook(chip8_env *env, uint16_t address, uint8_t value);
+
+/* buffer holds size() * observation_size() bytes and is owned by the caller, NULL uses an internal buffer */
+void chip8_env_set_observation_buffer(chip8_env *env, uint8_t *buffer);
+
+void chip8_env_reset(chip8_env *env, uint32_t seed);
+
+/* actions holds size() key masks. rewards and dones receive size() values each and may be NULL */
+void chip8_env_step(chip8_env *env, const uint16_t *actions, int frames_per_step, float *rewards, uint8_t *dones);
+
+const uint8_t *chip8_env_observations(const chip8_env *env);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CHIP8_CHIP8_ENV_H */
@@ -0,0 +1,211 @@
+#ifndef CHIP8_CHIP8_STATE_H
+#define CHIP8_CHIP8_STATE_H
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+const int KEY_COUNT = 16;
+const int REGISTER_COUNT = 16;
+const int MEMORY_SIZE = 4096;
+//XO-CHIP addresses 64 KB through F000 NNNN
+const int XO_MEMORY_SIZE = 0x10000;
+//the display holds one bit per plane, XO-CHIP has 2 planes
+const int PLANE_COUNT = 2;
+const int STACK_SIZE = 16;
+
+const int LOGICAL_WIDTH = 64;
+const int LOGICAL_HEIGHT = 32;
+
+const int PROGRAM_START = 0x200;
+const int FONT_START = 0x050;
+
+const int FONTSET_SIZE = 80;
+
+constexpr uint8_t FONTSET[FONTSET_SIZE] = {
+        0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+        0x20, 0x60, 0x20, 0x20, 0x70, // 1
+        0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+        0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+        0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+        0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+        0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+        0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+        0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+        0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+        0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+        0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+        0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+        0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+        0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+        0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+
+//The machine state shared by the interpreter and code generated by chip8-aot. It has no SDL dependency,
+//so generated translation units only need this header and native.h.
+struct Chip8State {
+    //memory is sized for the mode, so plain CHIP-8 machines only allocate 4 KB
+    explicit Chip8State(bool _xo_chip = false)
+            : xo_chip(_xo_chip), memory_size(_xo_chip ? XO_MEMORY_SIZE : MEMORY_SIZE),
+              memory_storage(std::make_unique<uint8_t[]>(memory_size)), memory(memory_storage.get()) {}
+
+    //display may point into the state itself
+    Chip8State(const Chip8State &) = delete;
+    Chip8State &operator=(const Chip8State &) = delete;
+
+    bool increment_I_on_index = false;
+
+    //enables the XO-CHIP instructions: F000 NNNN, FN01, 5XY2, 5XY3, 2 plane drawing and DXY0 16x16 sprites
+    bool xo_chip = false;
+
+    //a power of two, so addresses can wrap with memory_size - 1
+    int memory_size;
+    std::unique_ptr<uint8_t[]> memory_storage;
+    uint8_t *memory;
+
+    //LOGICAL_WIDTH * LOGICAL_HEIGHT bytes, normally own_display but it can be bound to an external buffer
+    //so many machines can draw straight into one contiguous array
+    uint8_t *display = own_display;
+    uint8_t own_display[LOGICAL_WIDTH * LOGICAL_HEIGHT] = {0};
+    uint16_t PC = PROGRAM_START;
+    uint16_t I = 0;
+
+    uint16_t stack[STACK_SIZE] = {0};
+    uint16_t SP = 0;
+    //deepest the stack has been since construction
+    uint16_t stack_high_water = 0;
+
+    uint8_t delay = 0;
+    uint8_t sound = 0;
+
+    uint8_t V[REGISTER_COUNT] = {0};
+
+    //planes drawn and cleared by DXYN and 00E0, bit 0 is plane 1. Set by FN01
+    uint8_t planes = 1;
+
+    bool keyboard[KEY_COUNT] = {false};
+    //true if the key was held at any point since the last poll, used to detect short presses in FX0A
+    bool prev_keyboard[KEY_COUNT] = {false};
+
+    bool draw_flag = false;
+
+    bool running_flag = false;
+
+    //addresses covered by native code, and whether anything has written inside them since it was loaded.
+    //Native code checks its instructions against the original image before running them once this is set
+    uint16_t native_low = 0;
+    uint16_t native_high = 0;
+    bool native_code_written = false;
+};
+
+//returns true if the write may have changed native code
+inline bool note_write(Chip8State &state, int address, int length) {
+    //the part of a write that wraps around the end of memory lands below PROGRAM_START, where no code is translated
+    address &= state.memory_size - 1;
+    if (address <= state.native_high && address + length > state.native_low) {
+        state.native_code_written = true;
+        return true;
+    }
+    return false;
+}
+
+//copies length bytes from data to memory[address], wrapping around the end of memory like every other access
+inline void store_memory(Chip8State &state, int address, const uint8_t *data, int length) {
+    for (int i = 0; i < length; ++i) {
+        state.memory[(address + i) & (state.memory_size - 1)] = data[i];
+    }
+}
+
+//copies length bytes from memory[address] to data, wrapping around the end of memory
+inline void load_memory(const Chip8State &state, int address, uint8_t *data, int length) {
+    for (int i = 0; i < length; ++i) {
+        data[i] = state.memory[(address + i) & (state.memory_size - 1)];
+    }
+}
+
+//SPRITE_ROWS[b] spreads the 8 pixels of sprite row b over 8 bytes in display order, so a row can be
+//XORed into the display 8 pixels at a time. Multiplying by a plane bit moves the pixels to that plane
+constexpr std::array<uint64_t, 256> make_sprite_rows() {
+    std::array<uint64_t, 256> rows{};
+    for (int b = 0; b < 256; ++b) {
+        std::array<uint8_t, 8> pixels{};
+        for (int i = 0; i < 8; ++i) {
+            pixels[i] = (b >> (7 - i)) & 1;
+        }
+        rows[b] = std::bit_cast<uint64_t>(pixels);
+    }
+    return rows;
+}
+
+inline constexpr std::array<uint64_t, 256> SPRITE_ROWS = make_sprite_rows();
+
+//XORs 8 sprite pixels into one plane at (x, y), returns true if a lit pixel was turned off
+inline bool draw_sprite_row(Chip8State &state, int x, int y, uint8_t pixels, uint8_t plane) {
+    if (x >= LOGICAL_WIDTH || y >= LOGICAL_HEIGHT || pixels == 0) {
+        return false;
+    }
+
+    uint8_t *dst = state.display + y * LOGICAL_WIDTH + x;
+    if (x + 8 <= LOGICAL_WIDTH) {
+        uint64_t bits = SPRITE_ROWS[pixels] * plane;
+        uint64_t old;
+        memcpy(&old, dst, sizeof(old));
+        uint64_t updated = old ^ bits;
+        memcpy(dst, &updated, sizeof(updated));
+        return (old & bits) != 0;
+    }
+
+    //do not wrap pixels that go over the right edge
+    bool collision = false;
+    for (int i = 0; x + i < LOGICAL_WIDTH; ++i) {
+        if (pixels & (0x80 >> i)) {
+            collision |= (dst[i] & plane) != 0;
+            dst[i] ^= plane;
+        }
+    }
+    return collision;
+}
+
+inline void draw_sprite(Chip8State &state, uint8_t X, uint8_t Y, uint8_t N) {
+    int x = state.V[X] % LOGICAL_WIDTH;
+    int y = state.V[Y] % LOGICAL_HEIGHT;
+    //XO-CHIP draws a 16x16 sprite for DXY0, 2 bytes per row
+    bool wide = state.xo_chip && N == 0;
+    int rows = wide ? 16 : N;
+    int row_bytes = wide ? 2 : 1;
+    int mask = state.memory_size - 1;
+    int address = state.I;
+    bool collision = false;
+
+    //every selected plane has its own sprite data, one after the other
+    for (int p = 0; p < PLANE_COUNT; ++p) {
+        uint8_t plane = 1 << p;
+        if (!(state.planes & plane)) {
+            continue;
+        }
+        for (int row = 0; row < rows; ++row) {
+            for (int b = 0; b < row_bytes; ++b) {
+                uint8_t pixels = state.memory[address++ & mask];
+                //rows below the bottom edge are not wrapped either
+                collision |= draw_sprite_row(state, x + b * 8, y + row, pixels, plane);
+            }
+        }
+    }
+
+    state.V[0xF] = collision;
+    state.draw_flag = true;
+}
+
+//00E0 only clears the selected planes
+inline void clear_display(Chip8State &state) {
+    uint8_t keep = ~state.planes;
+    for (int i = 0; i < LOGICAL_WIDTH * LOGICAL_HEIGHT; ++i) {
+        state.display[i] &= keep;
+    }
+    state.draw_flag = true;
+}
+
+
+#endif //CHIP8_CHIP8_STATE_H
@@ -0,0 +1,124 @@
+#include "environment.h"
+#include <algorithm>
+#include <thread>
+
+//worker jobs per thread per step, more than one so uneven machines still balance out
+const int CHUNKS_PER_THREAD = 4;
+
+
+VectorEnv::VectorEnv(const std::string &fname, int count, int threads, bool increment_I, int _ipf)
+        : ipf(_ipf),
+          pool(std::min(threads > 0 ? threads : static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u)),
+                        std::max(count, 1))) {
+    for (int i = 0; i < count; ++i) {
+        //audio is never opened, and unknown opcodes end the episode instead of being skipped
+        machines.push_back(std::make_unique<Chip8>(fname, false, true, increment_I, false));
+        if (!machines.back()->isRunning()) {
+            machines.clear();
+            return;
+        }
+    }
+    loaded = count > 0;
+
+    reward_values.resize(count, 0.0f);
+    done_flags.resize(count, 0);
+    episodes.resize(count, 0);
+    set_observation_buffer(nullptr);
+}
+
+void VectorEnv::set_observation_buffer(uint8_t *buffer) {
+    if (!buffer) {
+        own_observations.resize(machines.size() * OBSERVATION_SIZE);
+        buffer = own_observations.data();
+    }
+
+    observation_buffer = buffer;
+    for (size_t i = 0; i < machines.size(); ++i) {
+        machines[i]->bind_display(observation_buffer + i * OBSERVATION_SIZE);
+    }
+
+    if (buffer != own_observations.data()) {
+        own_observations.clear();
+        own_observations.shrink_to_fit();
+    }
+}
+
+template<typename Job>
+void VectorEnv::for_each_machine(Job job) {
+    int count = size();
+    int chunks = std::min(count, pool.size() * CHUNKS_PER_THREAD);
+    pool.run(chunks, [&](int chunk) {
+        for (int i = chunk * count / chunks; i < (chunk + 1) * count / chunks; ++i) {
+            job(i);
+        }
+    });
+}
+
+void VectorEnv::reset(uint32_t seed) {
+    base_seed = seed;
+    std::fill(episodes.begin(), episodes.end(), 0);
+    active_hooks = reward_hooks.size();
+    hook_values.assign(machines.size() * active_hooks, 0);
+    for_each_machine([&](int i) {
+        reset_machine(i);
+        reward_values[i] = 0.0f;
+        done_flags[i] = 0;
+    });
+}
+
+void VectorEnv::reset_machine(int i) {
+    Chip8 &machine = *machines[i];
+    machine.reset();
+    //every episode of every machine gets its own seed, and the same seed always replays the same episodes
+    machine.seed_random(base_seed + i + episodes[i] * static_cast<uint32_t>(machines.size()));
+    episodes[i]++;
+
+    for (size_t h = 0; h < active_hooks; ++h) {
+        hook_values[i * active_hooks + h] = read_hook(machine, reward_hooks[h]);
+    }
+}
+
+void VectorEnv::step(const uint16_t *actions, int frames_per_step) {
+    for_each_machine([&](int i) {
+        Chip8 &machine = *machines[i];
+        if (done_flags[i]) {
+            reset_machine(i);
+        }
+
+        machine.set_keys(actions[i]);
+        for (int frame = 0; frame < frames_per_step && machine.isRunning(); ++frame) {
+            machine.decrement_timers();
+            machine.run_frame(ipf);
+        }
+        machine.take_draw_flag();
+
+        float reward = 0.0f;
+        for (size_t h = 0; h < active_hooks; ++h) {
+            int64_t value = read_hook(machine, reward_hooks[h]);
+            int64_t &previous = hook_values[i * active_hooks + h];
+            reward += reward_hooks[h].scale * static_cast<float>(value - previous);
+            previous = value;
+        }
+        reward_values[i] = reward;
+        done_flags[i] = is_done(machine);
+    });
+
+    total_frames += static_cast<uint64_t>(frames_per_step) * machines.size();
+}
+
+int64_t VectorEnv::read_hook(const Chip8 &machine, const RewardHook &hook) const {
+    int64_t value = 0;
+    for (int b = 0; b < hook.length; ++b) {
+        value = value * (hook.bcd ? 10 : 256) + machine.peek(hook.address + b);
+    }
+    return value;
+}
+
+bool VectorEnv::is_done(const Chip8 &machine) const {
+    if (!machine.isRunning()) {
+        return true;
+    }
+    return std::any_of(done_hooks.begin(), done_hooks.end(), [&](const DoneHook &hook) {
+        return machine.peek(hook.address) == hook.value;
+    });
+}
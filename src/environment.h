@@ -0,0 +1,105 @@
+#ifndef CHIP8_ENVIRONMENT_H
+#define CHIP8_ENVIRONMENT_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "chip8.h"
+#include "worker_pool.h"
+
+//bytes per observation, one byte per pixel in the same layout as Chip8::get_display
+const int OBSERVATION_SIZE = LOGICAL_WIDTH * LOGICAL_HEIGHT;
+
+//Rewards come from a number in memory, e.g. a score. Each step the reward is scale times how much it changed
+struct RewardHook {
+    uint16_t address;
+    //number of bytes, most significant first
+    int length = 1;
+    //if true each byte is one decimal digit, which is how FX33 stores numbers
+    bool bcd = false;
+    float scale = 1.0f;
+};
+
+//an episode ends when memory[address] == value, or when the machine stops
+struct DoneHook {
+    uint16_t address;
+    uint8_t value;
+};
+
+//Runs many copies of one ROM as a reinforcement learning environment. The framebuffers of all copies are
+//stored contiguously in one observation buffer, which the caller can own, so observations are never copied.
+//Steps are spread over a worker pool.
+class VectorEnv {
+public:
+    //threads <= 0 uses one thread per core
+    VectorEnv(const std::string &fname, int count, int threads, bool increment_I, int _ipf);
+
+    int size() const { return static_cast<int>(machines.size()); }
+
+    //false if the ROM could not be loaded
+    bool is_loaded() const { return loaded; }
+
+    //reward hooks take effect from the next reset, until then they give no reward
+    void add_reward_hook(const RewardHook &hook) { reward_hooks.push_back(hook); }
+
+    void add_done_hook(const DoneHook &hook) { done_hooks.push_back(hook); }
+
+    //buffer holds size() * OBSERVATION_SIZE bytes and has to stay valid until it is replaced,
+    //nullptr goes back to a buffer owned by the environment
+    void set_observation_buffer(uint8_t *buffer);
+
+    //restarts every machine, machine i uses seed + i for its random numbers
+    void reset(uint32_t seed);
+
+    //holds actions[i] (bit k is key k) on machine i for frames_per_step frames. Machines that were done
+    //after the previous step are reset first, with a new seed
+    void step(const uint16_t *actions, int frames_per_step);
+
+    const uint8_t *observations() const { return observation_buffer; }
+
+    //per machine results of the last step
+    const float *rewards() const { return reward_values.data(); }
+
+    const uint8_t *dones() const { return done_flags.data(); }
+
+    //frames run by all machines since construction
+    uint64_t frames_run() const { return total_frames; }
+
+private:
+    int ipf;
+    bool loaded = false;
+
+    std::vector<std::unique_ptr<Chip8>> machines;
+    WorkerPool pool;
+
+    std::vector<uint8_t> own_observations;
+    uint8_t *observation_buffer = nullptr;
+
+    std::vector<RewardHook> reward_hooks;
+    std::vector<DoneHook> done_hooks;
+
+    //the first active_hooks reward hooks are the ones in use since the last reset
+    size_t active_hooks = 0;
+    //hook values at the end of the previous step, active_hooks per machine
+    std::vector<int64_t> hook_values;
+    std::vector<float> reward_values;
+    std::vector<uint8_t> done_flags;
+
+    uint32_t base_seed = 0;
+    std::vector<uint32_t> episodes;
+    uint64_t total_frames = 0;
+
+    void reset_machine(int i);
+
+    int64_t read_hook(const Chip8 &machine, const RewardHook &hook) const;
+
+    bool is_done(const Chip8 &machine) const;
+
+    //calls job(i) for every machine, in contiguous chunks so each worker job covers many machines
+    template<typename Job>
+    void for_each_machine(Job job);
+};
+
+
+#endif //CHIP8_ENVIRONMENT_H
@@ -0,0 +1,139 @@
+#include "frame_pacer.h"
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <thread>
+
+
+void FrameHistogram::record(std::chrono::nanoseconds duration) {
+    double us = std::chrono::duration<double, std::micro>(duration).count();
+    int bucket = std::clamp(static_cast<int>(us / HISTOGRAM_BUCKET_US), 0, HISTOGRAM_BUCKETS - 1);
+    buckets[bucket]++;
+
+    if (samples == 0 || us < min_us) min_us = us;
+    if (samples == 0 || us > max_us) max_us = us;
+    total_us += us;
+    samples++;
+}
+
+double FrameHistogram::percentile(double p) const {
+    if (samples == 0) {
+        return 0;
+    }
+
+    auto target = static_cast<uint64_t>(std::ceil(p * static_cast<double>(samples)));
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        seen += buckets[i];
+        if (seen >= target) {
+            //the last bucket is open ended, so the max is the best upper bound we have
+            if (i == HISTOGRAM_BUCKETS - 1) return max_us / 1000.0;
+            return std::min((i + 1) * HISTOGRAM_BUCKET_US / 1000.0, max_us / 1000.0);
+        }
+    }
+    return max_us / 1000.0;
+}
+
+double FrameHistogram::mean_ms() const {
+    return samples == 0 ? 0 : total_us / static_cast<double>(samples) / 1000.0;
+}
+
+void FrameHistogram::reset() {
+    *this = FrameHistogram();
+}
+
+std::string FrameHistogram::summary() const {
+    return std::format("n={} mean={:.3f}ms min={:.3f}ms p50={:.3f}ms p90={:.3f}ms p99={:.3f}ms max={:.3f}ms",
+                       samples, mean_ms(), min_us / 1000.0, percentile(0.5), percentile(0.9), percentile(0.99),
+                       max_us / 1000.0);
+}
+
+
+int FramePacer::begin_frame() {
+    auto now = clock::now();
+
+    if (!started) {
+        started = true;
+        deadline = now;
+        segment_start = now;
+    } else {
+        frame_hist.record(now - last_frame);
+    }
+    last_frame = now;
+    frames++;
+
+    int due = 1;
+    if (now > deadline) {
+        due += static_cast<int>((now - deadline) / FRAME_DURATION);
+    }
+
+    if (due > max_catch_up + 1) {
+        //too far behind to catch up without a visible burst, drop the rest and restart the schedule from now.
+        //the ticks run this iteration are treated as already due, so the next frame is one frame from now
+        dropped += due - (max_catch_up + 1);
+        due = max_catch_up + 1;
+        deadline = now - (due - 1) * FRAME_DURATION;
+    }
+
+    deadline += due * FRAME_DURATION;
+    return due;
+}
+
+void FramePacer::timer_tick() {
+    auto now = clock::now();
+    if (have_last_tick) {
+        tick_hist.record(now - last_tick);
+    }
+    have_last_tick = true;
+    last_tick = now;
+    ticks++;
+}
+
+void FramePacer::wait() {
+    if (!started) {
+        return;
+    }
+
+    if (spin) {
+        //the OS sleep is only accurate to around a millisecond, so sleep most of the way and spin the rest
+        std::this_thread::sleep_until(deadline - SPIN_MARGIN);
+        while (clock::now() < deadline) {
+        }
+    } else {
+        std::this_thread::sleep_until(deadline);
+    }
+}
+
+void FramePacer::resync() {
+    if (started) {
+        active_time += clock::now() - segment_start;
+        started = false;
+    }
+    have_last_tick = false;
+}
+
+std::chrono::nanoseconds FramePacer::elapsed() const {
+    if (started) {
+        return active_time + (clock::now() - segment_start);
+    }
+    return active_time;
+}
+
+std::string FramePacer::overlay() const {
+    double fps = frame_hist.mean_ms() > 0 ? 1000.0 / frame_hist.mean_ms() : 0;
+    return std::format("{:.1f} fps | p99 {:.2f}ms | dropped {}", fps, frame_hist.percentile(0.99), dropped);
+}
+
+std::string FramePacer::report() const {
+    double seconds = std::chrono::duration<double>(elapsed()).count();
+    double expected_ticks = seconds * FRAME_RATE;
+    double drift_ms = (static_cast<double>(ticks) - expected_ticks) * 1000.0 / FRAME_RATE;
+
+    std::string out;
+    out += std::format("Frame times:    {}\n", frame_hist.summary());
+    out += std::format("Timer ticks:    {}\n", tick_hist.summary());
+    out += std::format("Timer accuracy: {} ticks in {:.3f}s (expected {:.1f}), drift {:+.3f}ms\n",
+                       ticks, seconds, expected_ticks, drift_ms);
+    out += std::format("Frames:         {} presented, {} dropped\n", frames, dropped);
+    return out;
+}
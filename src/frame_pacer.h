@@ -0,0 +1,106 @@
+#ifndef CHIP8_FRAME_PACER_H
+#define CHIP8_FRAME_PACER_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+const int FRAME_RATE = 60;
+const std::chrono::nanoseconds FRAME_DURATION(1000000000 / FRAME_RATE);
+
+//how long before a deadline we stop sleeping and start spinning when hybrid waiting is enabled
+const std::chrono::nanoseconds SPIN_MARGIN(1500000);
+
+const int DEFAULT_MAX_CATCH_UP = 4;
+
+//histogram buckets are 100us wide, anything over 50ms goes into the last bucket
+const int HISTOGRAM_BUCKET_US = 100;
+const int HISTOGRAM_BUCKETS = 500;
+
+class FrameHistogram {
+public:
+    void record(std::chrono::nanoseconds duration);
+
+    //returns the upper bound of the bucket containing the given percentile, in milliseconds
+    double percentile(double p) const;
+
+    double mean_ms() const;
+
+    uint64_t count() const { return samples; }
+
+    void reset();
+
+    std::string summary() const;
+
+private:
+    uint64_t buckets[HISTOGRAM_BUCKETS] = {0};
+    uint64_t samples = 0;
+    double total_us = 0;
+    double min_us = 0;
+    double max_us = 0;
+};
+
+//Schedules frames against absolute deadlines so time spent polling input, executing and presenting
+//is absorbed by the frame instead of being added on top of it.
+class FramePacer {
+public:
+    FramePacer() = default;
+
+    FramePacer(int _max_catch_up, bool _spin) : max_catch_up(_max_catch_up), spin(_spin) {}
+
+    //returns how many 60 Hz ticks are due this iteration (at least 1).
+    //if we fall further behind than max_catch_up, the extra ticks are dropped and the schedule restarts from now
+    int begin_frame();
+
+    //records a single timer tick, should be called right after decrement_timers()
+    void timer_tick();
+
+    //waits until the deadline of the next frame
+    void wait();
+
+    //restarts the schedule from now, used after pausing so we do not try to catch up on the paused time
+    void resync();
+
+    uint64_t dropped_frames() const { return dropped; }
+
+    uint64_t presented_frames() const { return frames; }
+
+    const FrameHistogram &frame_times() const { return frame_hist; }
+
+    const FrameHistogram &tick_intervals() const { return tick_hist; }
+
+    //short single line summary, used for the window title overlay
+    std::string overlay() const;
+
+    //full report of frame times and timer accuracy
+    std::string report() const;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    int max_catch_up = DEFAULT_MAX_CATCH_UP;
+    bool spin = false;
+
+    bool started = false;
+    clock::time_point deadline;
+    clock::time_point last_frame;
+    clock::time_point last_tick;
+
+    bool have_last_tick = false;
+
+    //used to compare the number of timer ticks against wall clock time, time spent paused is not counted
+    clock::time_point segment_start;
+    std::chrono::nanoseconds active_time{0};
+    uint64_t ticks = 0;
+
+    uint64_t frames = 0;
+    uint64_t dropped = 0;
+
+    FrameHistogram frame_hist;
+    FrameHistogram tick_hist;
+
+    std::chrono::nanoseconds elapsed() const;
+};
+
+
+#endif //CHIP8_FRAME_PACER_H
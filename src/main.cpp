@@ -1,9 +1,16 @@
 #include <iostream>
+#include <format>
+#include <cstring>
 #include <SDL3/SDL.h>
 #include <getopt.h>
 #include <thread>
 #include "chip8.h"
 #include "audio.h"
+#include "frame_pacer.h"
+#include "wall.h"
+#include "recorder.h"
+#include "mem_profile.h"
+#include "metrics.h"
 
 int main(int argc, char *argv[]) {
     int c;
@@ -11,13 +18,49 @@ int main(int argc, char *argv[]) {
     bool debug = false;
     bool exit_on_unknown = true;
     bool increment_I_on_index = true;
-    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS | SDL_INIT_AUDIO);
+    bool frame_stats = false;
+    bool spin = false;
+    int max_catch_up = DEFAULT_MAX_CATCH_UP;
+    Palette palette = DEFAULT_PALETTE;
+    PostProcessSettings post_settings;
+    SDL_Scancode keymap[KEY_COUNT];
+    memcpy(keymap, KEYMAP, sizeof(keymap));
+    bool timestamped_input = false;
+    bool idle_skip = true;
+    bool native_code = true;
+    bool xo_chip = false;
+    int wall_cols = 0;
+    int wall_rows = 0;
+    std::string record_path;
+    //number of frames to run without a window, 0 opens the window as usual
+    uint64_t headless_frames = 0;
+    bool turbo = false;
+    std::string mem_profile_path;
+    int metrics_port = 0;
 
     const struct option longopts[] = {
             {"ignore",            no_argument,       nullptr, 'e'},
             {"debug",             no_argument,       nullptr, 'd'},
             {"ipf",               required_argument, nullptr, 'i'},
             {"no-inc-i-on-index", no_argument,       nullptr, 'c'},
+            {"frame-stats",       no_argument,       nullptr, 'f'},
+            {"spin",              no_argument,       nullptr, 's'},
+            {"max-catch-up",      required_argument, nullptr, 'm'},
+            {"palette",           required_argument, nullptr, 'p'},
+            {"phosphor",          required_argument, nullptr, 'o'},
+            {"scanlines",         no_argument,       nullptr, 'l'},
+            {"scale",             required_argument, nullptr, 'x'},
+            {"keymap",            required_argument, nullptr, 'k'},
+            {"timestamped-input", no_argument,       nullptr, 'n'},
+            {"wall",              required_argument, nullptr, 'w'},
+            {"no-idle-skip",      no_argument,       nullptr, 'j'},
+            {"no-native",         no_argument,       nullptr, 'a'},
+            {"xo-chip",           no_argument,       nullptr, 'g'},
+            {"record",            required_argument, nullptr, 'r'},
+            {"headless",          required_argument, nullptr, 'h'},
+            {"turbo",             no_argument,       nullptr, 't'},
+            {"mem-profile",       required_argument, nullptr, 'y'},
+            {"metrics-port",      required_argument, nullptr, 'z'},
             {nullptr,             0,                 nullptr, 0}
     };
 
@@ -37,41 +80,268 @@ int main(int argc, char *argv[]) {
             case 'c':
                 increment_I_on_index = false;
                 break;
+            case 'f':
+                frame_stats = true;
+                break;
+            case 's':
+                spin = true;
+                break;
+            case 'm':
+                max_catch_up = atoi(optarg);
+                break;
+            case 'p':
+                if (!parse_palette(optarg, palette)) {
+                    std::cerr << "ERROR: Palette must be 2 or 4 comma separated RRGGBB colours\n";
+                    return 0;
+                }
+                break;
+            case 'o':
+                post_settings.phosphor_frames = atoi(optarg);
+                break;
+            case 'l':
+                post_settings.scanlines = true;
+                break;
+            case 'x':
+                post_settings.scale = atoi(optarg);
+                break;
+            case 'k':
+                if (!parse_keymap(optarg, keymap)) {
+                    std::cerr << "ERROR: Keymap must be 16 key names, in keypad order 0 to F\n";
+                    return 0;
+                }
+                break;
+            case 'n':
+                timestamped_input = true;
+                break;
+            case 'j':
+                idle_skip = false;
+                break;
+            case 'a':
+                native_code = false;
+                break;
+            case 'g':
+                xo_chip = true;
+                break;
+            case 'r':
+                record_path = optarg;
+                break;
+            case 'h':
+                headless_frames = strtoull(optarg, nullptr, 10);
+                if (headless_frames == 0) {
+                    std::cerr << "ERROR: Headless mode needs the number of frames to run\n";
+                    return 0;
+                }
+                break;
+            case 't':
+                turbo = true;
+                break;
+            case 'y':
+                mem_profile_path = optarg;
+                break;
+            case 'z':
+                metrics_port = atoi(optarg);
+                if (metrics_port <= 0 || metrics_port > 65535) {
+                    std::cerr << "ERROR: Metrics port must be between 1 and 65535\n";
+                    return 0;
+                }
+                break;
+            case 'w':
+                if (sscanf(optarg, "%dx%d", &wall_cols, &wall_rows) != 2 || wall_cols < 1 || wall_rows < 1) {
+                    std::cerr << "ERROR: Wall size must be given as <columns>x<rows>\n";
+                    return 0;
+                }
+                break;
             default:
                 abort();
         }
     }
 
+    //headless runs on machines without a display, so only the event queue is needed
+    SDL_Init(headless_frames > 0 ? SDL_INIT_EVENTS : SDL_INIT_VIDEO | SDL_INIT_EVENTS | SDL_INIT_AUDIO);
+    //registered with atexit so it runs after the windows owned by main have been destroyed
+    atexit(SDL_Quit);
+
+    if (wall_cols > 0) {
+        if (!record_path.empty() || headless_frames > 0 || turbo || !mem_profile_path.empty() || metrics_port > 0) {
+            std::cerr << "ERROR: --record, --headless, --turbo, --mem-profile and --metrics-port can not be used "
+                         "with --wall\n";
+            return 0;
+        }
+        if (optind >= argc) {
+            std::cerr << "Usage: ./chip8 --wall <columns>x<rows> [options] input.ch8...\n";
+            return 0;
+        }
+
+        Wall wall(wall_cols, wall_rows, std::vector<std::string>(argv + optind, argv + argc), exit_on_unknown,
+                  increment_I_on_index, ipf, palette, idle_skip);
+        FramePacer pacer(max_catch_up, spin);
+        wall.run(pacer, frame_stats);
+        if (frame_stats) {
+            std::cout << pacer.report() << wall.report();
+        }
+        return 0;
+    }
+
     if (argc - optind != 1) {
         std::cerr << "Usage: ./chip8 [options] input.ch8\n";
         return 0;
     }
-    Chip8 chip8(argv[optind++], debug, exit_on_unknown, increment_I_on_index);
+    std::string rom = argv[optind++];
+    if (rom.ends_with(".xo8")) {
+        xo_chip = true;
+    }
+    Chip8 chip8(rom, debug, exit_on_unknown, increment_I_on_index, headless_frames == 0, xo_chip);
     if (!chip8.isRunning()) {
         return 0;
     }
-    Screen screen;
+    chip8.set_keymap(keymap);
+    chip8.set_timestamped_input(timestamped_input);
+    chip8.set_idle_skip(idle_skip);
+    if (!native_code) {
+        chip8.set_native_code(false);
+    }
+    //scanlines need room to be drawn, so default to upscaling to the window size
+    if (post_settings.scanlines && post_settings.scale <= 1) {
+        post_settings.scale = WINDOW_WIDTH / LOGICAL_WIDTH;
+    }
+    int planes = chip8.is_xo_chip() ? PLANE_COUNT : 1;
+    std::unique_ptr<Screen> screen;
+    if (headless_frames == 0) {
+        screen = std::make_unique<Screen>(palette, post_settings);
+        screen->set_planes(planes);
+    }
+    std::unique_ptr<FrameRecorder> recorder;
+    if (!record_path.empty()) {
+        recorder = std::make_unique<FrameRecorder>(record_path, palette, planes);
+        if (!recorder->is_open()) {
+            return 0;
+        }
+    }
+    std::unique_ptr<MemoryProfile> mem_profile;
+    std::vector<uint32_t> heatmap(LOGICAL_WIDTH * LOGICAL_HEIGHT);
+    if (!mem_profile_path.empty()) {
+        mem_profile = std::make_unique<MemoryProfile>(chip8.get_memory_size());
+        chip8.set_memory_profile(mem_profile.get());
+    }
+    //declared before the server so it outlives the server thread reading it
+    Metrics metrics;
+    std::unique_ptr<MetricsServer> metrics_server;
+    if (metrics_port > 0) {
+        metrics_server = std::make_unique<MetricsServer>(metrics, metrics_port);
+        if (!metrics_server->is_open()) {
+            return 0;
+        }
+    }
+    FramePacer pacer(max_catch_up, spin);
+    auto last_overlay = std::chrono::steady_clock::now();
+    auto last_metrics_rate = std::chrono::steady_clock::now();
+    auto start = std::chrono::steady_clock::now();
+    uint64_t frames_run = 0;
 
-    while (chip8.isRunning()) {
+    while (chip8.isRunning() && (headless_frames == 0 || frames_run < headless_frames)) {
         chip8.update_inputs();
-        chip8.decrement_timers();
 
-        auto frame_start = std::chrono::high_resolution_clock::now();
-        if (!chip8.isStepping()) {
-            for (int i = 0; i < ipf && !chip8.is_draw_flag(); ++i) {
+        if (chip8.isStepping()) {
+            pacer.resync();
+            chip8.decrement_timers();
+            if (chip8.should_execute_next()) {
                 chip8.execute_loop();
             }
-        } else if (chip8.should_execute_next()) {
-            chip8.execute_loop();
+            if (screen) {
+                chip8.draw(*screen);
+            }
+            continue;
         }
 
-        chip8.draw(screen);
+        //if the previous frame overran, run the ticks we missed before presenting so the timers stay at 60 Hz.
+        //turbo runs one tick per iteration and does not wait, so it runs as fast as the host allows
+        int ticks = turbo ? 1 : pacer.begin_frame();
+        for (int tick = 0; tick < ticks && chip8.isRunning(); ++tick) {
+            chip8.decrement_timers();
+            if (!turbo) {
+                pacer.timer_tick();
+            }
+            chip8.run_frame(ipf);
+            //every tick is recorded, so the video runs at exactly 60 frames per second of emulated time
+            if (recorder) {
+                recorder->add_frame(chip8.get_display());
+            }
+            frames_run++;
+        }
+
+        if (screen && mem_profile) {
+            mem_profile->render_heatmap(heatmap.data());
+            screen->set_heatmap(heatmap.data());
+        }
+        if (screen) {
+            chip8.draw(*screen);
+        } else {
+            chip8.take_draw_flag();
+        }
+
+        if (metrics_server) {
+            metrics.publish(chip8, pacer, turbo ? frames_run : pacer.presented_frames());
+            if (std::chrono::steady_clock::now() - last_metrics_rate >= std::chrono::seconds(1)) {
+                metrics.publish_rates(chip8, pacer);
+                last_metrics_rate = std::chrono::steady_clock::now();
+            }
+        }
 
-        if (!chip8.isStepping()) {
-            std::this_thread::sleep_until(frame_start + std::chrono::nanoseconds(16666667));
+        if (screen && frame_stats && std::chrono::steady_clock::now() - last_overlay >= std::chrono::seconds(1)) {
+            screen->set_overlay(turbo ? std::format("{} frames", frames_run) : pacer.overlay());
+            last_overlay = std::chrono::steady_clock::now();
+        }
+
+        if (!turbo) {
+            pacer.wait();
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (recorder) {
+        recorder->finish();
+        if (recorder->dropped_frames() > 0) {
+            std::cerr << std::format("WARNING: {} of {} frames were dropped because the recording could not keep up\n",
+                                     recorder->dropped_frames(), recorder->frames_added());
+        }
+    }
+
+    if (mem_profile) {
+        chip8.set_memory_profile(nullptr);
+        if (!mem_profile->save(mem_profile_path)) {
+            std::cerr << "ERROR: Could not write the memory profile to " << mem_profile_path << "\n";
         }
     }
 
+    if (frame_stats) {
+        if (turbo) {
+            std::cout << std::format("Turbo:          {} frames in {:.2f}s ({:.0f} frames/s)\n", frames_run, seconds,
+                                     frames_run / seconds);
+        } else {
+            std::cout << pacer.report();
+        }
+        std::cout << std::format("Input latency:  {}\n", chip8.input_latency().summary());
+        std::cout << std::format("Idle skip:      {} of {} instructions skipped ({:.3f}s of emulated time)\n",
+                                 chip8.instructions_skipped(), chip8.cycles_elapsed(),
+                                 static_cast<double>(chip8.instructions_skipped()) / ipf / FRAME_RATE);
+        if (chip8.has_native_code()) {
+            std::cout << std::format("Native code:    {} of {} instructions\n",
+                                     chip8.native_instructions(), chip8.instructions_executed());
+        }
+        if (screen && screen->post_processor()) {
+            std::cout << std::format("Post-process:   {} ({} over the {:.1f}ms budget)\n",
+                                     screen->post_processor()->frame_times().summary(),
+                                     screen->post_processor()->over_budget_frames(), POST_PROCESS_BUDGET_MS);
+        }
+        if (mem_profile) {
+            std::cout << std::format("Memory profile: {}\n", mem_profile->summary());
+        }
+        if (recorder) {
+            std::cout << std::format("Recording:      {} frames, {} duplicates, {} dropped\n",
+                                     recorder->frames_added(), recorder->duplicate_frames(),
+                                     recorder->dropped_frames());
+        }
+    }
 
     return 0;
 }
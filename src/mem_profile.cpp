@@ -0,0 +1,115 @@
+#include "mem_profile.h"
+#include <algorithm>
+#include <bit>
+#include <format>
+#include <fstream>
+#include "chip8_state.h"
+
+MemoryProfile::MemoryProfile(int _memory_size)
+        : mask(_memory_size - 1), reads(_memory_size), writes(_memory_size), executes(_memory_size),
+          modified_code(_memory_size) {}
+
+void MemoryProfile::add_self_modifying_write(int address, uint16_t pc, uint64_t instruction) {
+    modified_code[address] = true;
+    self_modifying_count++;
+    if (self_modifying.size() < MAX_SELF_MODIFYING_WRITES) {
+        self_modifying.push_back({static_cast<uint16_t>(address), pc, instruction});
+    }
+}
+
+void MemoryProfile::render_heatmap(uint32_t *pixels) const {
+    const int cells = LOGICAL_WIDTH * LOGICAL_HEIGHT;
+    const int cell_size = std::max(1, size() / cells);
+
+    //counts span many orders of magnitude, so the brightness follows the number of bits in the count
+    int levels[3][LOGICAL_WIDTH * LOGICAL_HEIGHT] = {};
+    int max_level = 1;
+    for (int cell = 0; cell < cells && cell * cell_size < size(); ++cell) {
+        uint64_t sums[3] = {0, 0, 0};
+        for (int a = cell * cell_size; a < (cell + 1) * cell_size; ++a) {
+            sums[0] += writes[a];
+            sums[1] += reads[a];
+            sums[2] += executes[a];
+        }
+        for (int c = 0; c < 3; ++c) {
+            levels[c][cell] = std::bit_width(sums[c]);
+            max_level = std::max(max_level, levels[c][cell]);
+        }
+    }
+
+    for (int cell = 0; cell < cells; ++cell) {
+        if (cell * cell_size >= size() || (levels[0][cell] | levels[1][cell] | levels[2][cell]) == 0) {
+            pixels[cell] = 0;
+            continue;
+        }
+        bool modified = false;
+        for (int a = cell * cell_size; a < (cell + 1) * cell_size; ++a) {
+            modified |= modified_code[a];
+        }
+        uint32_t r = levels[0][cell] * 255 / max_level;
+        uint32_t g = levels[1][cell] * 255 / max_level;
+        uint32_t b = levels[2][cell] * 255 / max_level;
+        uint32_t alpha = modified ? 255 : 160;
+        pixels[cell] = r << 24 | g << 16 | b << 8 | alpha;
+    }
+}
+
+bool MemoryProfile::save(const std::string &path) const {
+    std::ofstream file(path);
+    if (!file) {
+        return false;
+    }
+
+    bool json = path.ends_with(".json");
+    if (json) {
+        file << std::format("{{\n  \"memory_size\": {},\n  \"self_modifying_write_count\": {},\n  \"addresses\": [",
+                            size(), self_modifying_count);
+    } else {
+        file << "address,reads,writes,executes,self_modified\n";
+    }
+
+    bool first = true;
+    for (int a = 0; a < size(); ++a) {
+        if (reads[a] == 0 && writes[a] == 0 && executes[a] == 0) {
+            continue;
+        }
+        if (json) {
+            file << std::format("{}\n    {{\"address\": {}, \"reads\": {}, \"writes\": {}, \"executes\": {}, "
+                                "\"self_modified\": {}}}", first ? "" : ",", a, reads[a], writes[a], executes[a],
+                                modified_code[a] ? "true" : "false");
+        } else {
+            file << std::format("{},{},{},{},{}\n", a, reads[a], writes[a], executes[a], modified_code[a] ? 1 : 0);
+        }
+        first = false;
+    }
+
+    if (json) {
+        file << "\n  ],\n  \"self_modifying_writes\": [";
+        for (size_t i = 0; i < self_modifying.size(); ++i) {
+            const SelfModifyingWrite &write = self_modifying[i];
+            file << std::format("{}\n    {{\"address\": {}, \"pc\": {}, \"instruction\": {}}}", i == 0 ? "" : ",",
+                                write.address, write.pc, write.instruction);
+        }
+        file << "\n  ]\n}\n";
+    }
+
+    return static_cast<bool>(file);
+}
+
+std::string MemoryProfile::summary() const {
+    int read = 0;
+    int written = 0;
+    int executed = 0;
+    for (int a = 0; a < size(); ++a) {
+        read += reads[a] > 0;
+        written += writes[a] > 0;
+        executed += executes[a] > 0;
+    }
+    std::string text = std::format("{} addresses read, {} written, {} executed, {} writes to executed code",
+                                   read, written, executed, self_modifying_count);
+    if (!self_modifying.empty()) {
+        text += std::format(" (first at {:03X} by the instruction at {:03X})", self_modifying[0].address,
+                            self_modifying[0].pc);
+    }
+    return text;
+}
@@ -0,0 +1,88 @@
+#ifndef CHIP8_MEM_PROFILE_H
+#define CHIP8_MEM_PROFILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//only the first writes to executed code are kept, after that they are only counted
+const size_t MAX_SELF_MODIFYING_WRITES = 1000;
+
+//a write to an address that had already been executed as an instruction
+struct SelfModifyingWrite {
+    uint16_t address;
+    //address of the instruction that did the write
+    uint16_t pc;
+    //instructions executed before the write
+    uint64_t instruction;
+};
+
+//Per address counts of how often memory is read as data (DXYN, FX65, 5XY3), written (FX33, FX55, 5XY2)
+//and fetched as an instruction. Filled in by the instrumented variant of the interpreter, see
+//Chip8::set_memory_profile
+class MemoryProfile {
+public:
+    explicit MemoryProfile(int _memory_size);
+
+    void read(int address, int length) {
+        for (int i = 0; i < length; ++i) {
+            reads[(address + i) & mask]++;
+        }
+    }
+
+    void write(int address, int length, uint16_t pc, uint64_t instruction) {
+        for (int i = 0; i < length; ++i) {
+            int a = (address + i) & mask;
+            writes[a]++;
+            if (executes[a] > 0) {
+                add_self_modifying_write(a, pc, instruction);
+            }
+        }
+    }
+
+    void execute(int address, int length) {
+        for (int i = 0; i < length; ++i) {
+            executes[(address + i) & mask]++;
+        }
+    }
+
+    int size() const { return static_cast<int>(reads.size()); }
+
+    uint64_t reads_at(int address) const { return reads[address]; }
+
+    uint64_t writes_at(int address) const { return writes[address]; }
+
+    uint64_t executes_at(int address) const { return executes[address]; }
+
+    uint64_t self_modifying_write_count() const { return self_modifying_count; }
+
+    //the first MAX_SELF_MODIFYING_WRITES of them
+    const std::vector<SelfModifyingWrite> &self_modifying_writes() const { return self_modifying; }
+
+    //fills LOGICAL_WIDTH * LOGICAL_HEIGHT RGBA8888 pixels, one per memory_size / pixel count addresses in
+    //address order. Red is writes, green reads and blue executes, each on a log scale. Untouched memory is
+    //transparent, and cells with self-modifying writes are opaque
+    void render_heatmap(uint32_t *pixels) const;
+
+    //writes every address that was accessed, as JSON if path ends in .json and as CSV otherwise
+    bool save(const std::string &path) const;
+
+    //single line summary for the exit report
+    std::string summary() const;
+
+private:
+    int mask;
+    std::vector<uint64_t> reads;
+    std::vector<uint64_t> writes;
+    std::vector<uint64_t> executes;
+
+    //set for addresses that were written after being executed
+    std::vector<bool> modified_code;
+    uint64_t self_modifying_count = 0;
+    std::vector<SelfModifyingWrite> self_modifying;
+
+    void add_self_modifying_write(int address, uint16_t pc, uint64_t instruction);
+};
+
+
+#endif //CHIP8_MEM_PROFILE_H
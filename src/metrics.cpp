@@ -0,0 +1,151 @@
+#include "metrics.h"
+#include <arpa/inet.h>
+#include <format>
+#include <iostream>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+//how often the server thread checks whether it should stop while no one is connecting
+const int METRICS_POLL_MS = 100;
+
+void Metrics::publish(const Chip8 &chip8, const FramePacer &pacer, uint64_t presented) {
+    instructions.store(chip8.instructions_executed(), std::memory_order_relaxed);
+    frames_presented.store(presented, std::memory_order_relaxed);
+    frames_dropped.store(pacer.dropped_frames(), std::memory_order_relaxed);
+    audio_underruns.store(chip8.audio_underruns(), std::memory_order_relaxed);
+    unknown_opcodes.store(chip8.unknown_opcodes(), std::memory_order_relaxed);
+    stack_high_water.store(chip8.stack_depth_high_water(), std::memory_order_relaxed);
+}
+
+void Metrics::publish_rates(const Chip8 &chip8, const FramePacer &pacer) {
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - rate_start).count();
+    if (seconds > 0) {
+        instructions_per_second.store((chip8.instructions_executed() - rate_instructions) / seconds,
+                                      std::memory_order_relaxed);
+    }
+    rate_instructions = chip8.instructions_executed();
+    rate_start = now;
+
+    //the histogram is in milliseconds, Prometheus expects seconds
+    const FrameHistogram &frame_times = pacer.frame_times();
+    frame_time_p50.store(frame_times.percentile(0.5) / 1000.0, std::memory_order_relaxed);
+    frame_time_p90.store(frame_times.percentile(0.9) / 1000.0, std::memory_order_relaxed);
+    frame_time_p99.store(frame_times.percentile(0.99) / 1000.0, std::memory_order_relaxed);
+    frame_time_sum.store(frame_times.mean_ms() * frame_times.count() / 1000.0, std::memory_order_relaxed);
+    frame_time_count.store(frame_times.count(), std::memory_order_relaxed);
+}
+
+std::string Metrics::prometheus_text() const {
+    std::string out;
+    auto metric = [&](const char *name, const char *type, const char *help, auto value) {
+        out += std::format("# HELP {} {}\n# TYPE {} {}\n{} {}\n", name, help, name, type, name, value);
+    };
+    auto relaxed = std::memory_order_relaxed;
+
+    metric("chip8_instructions_total", "counter", "Instructions executed, including native code.",
+           instructions.load(relaxed));
+    metric("chip8_instructions_per_second", "gauge", "Instructions executed per second over the last second.",
+           instructions_per_second.load(relaxed));
+    metric("chip8_frames_presented_total", "counter", "Frames presented.", frames_presented.load(relaxed));
+    metric("chip8_frames_dropped_total", "counter", "Frames dropped after falling too far behind.",
+           frames_dropped.load(relaxed));
+
+    out += "# HELP chip8_frame_time_seconds Time from one presented frame to the next.\n"
+           "# TYPE chip8_frame_time_seconds summary\n";
+    out += std::format("chip8_frame_time_seconds{{quantile=\"0.5\"}} {}\n", frame_time_p50.load(relaxed));
+    out += std::format("chip8_frame_time_seconds{{quantile=\"0.9\"}} {}\n", frame_time_p90.load(relaxed));
+    out += std::format("chip8_frame_time_seconds{{quantile=\"0.99\"}} {}\n", frame_time_p99.load(relaxed));
+    out += std::format("chip8_frame_time_seconds_sum {}\n", frame_time_sum.load(relaxed));
+    out += std::format("chip8_frame_time_seconds_count {}\n", frame_time_count.load(relaxed));
+
+    metric("chip8_audio_underruns_total", "counter", "Times the audio device ran out of samples.",
+           audio_underruns.load(relaxed));
+    metric("chip8_unknown_opcodes_total", "counter", "Unknown opcodes encountered.", unknown_opcodes.load(relaxed));
+    metric("chip8_stack_depth_max", "gauge", "Deepest the call stack has been.", stack_high_water.load(relaxed));
+    return out;
+}
+
+MetricsServer::MetricsServer(const Metrics &_metrics, int port) : metrics(_metrics) {
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        std::cerr << "ERROR: Could not create the metrics socket\n";
+        return;
+    }
+
+    int reuse = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    //loopback only, the metrics are not meant to be reachable from other machines
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listen_fd, 8) != 0) {
+        std::cerr << "ERROR: Could not listen for metrics on port " << port << "\n";
+        close(listen_fd);
+        listen_fd = -1;
+        return;
+    }
+
+    thread = std::thread(&MetricsServer::serve, this);
+}
+
+MetricsServer::~MetricsServer() {
+    stopping = true;
+    if (thread.joinable()) {
+        thread.join();
+    }
+    if (listen_fd >= 0) {
+        close(listen_fd);
+    }
+}
+
+void MetricsServer::serve() {
+    pollfd listener{listen_fd, POLLIN, 0};
+    while (!stopping) {
+        if (poll(&listener, 1, METRICS_POLL_MS) <= 0) {
+            continue;
+        }
+        int client = accept(listen_fd, nullptr, nullptr);
+        if (client >= 0) {
+            respond(client);
+            close(client);
+        }
+    }
+}
+
+void MetricsServer::respond(int client) {
+    //a scraper that never sends its request should not hold up the next one for long
+    timeval timeout{1, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    //the request is read up to the end of its headers and otherwise ignored
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+        ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            break;
+        }
+        request.append(buffer, received);
+    }
+
+    std::string body = metrics.prometheus_text();
+    std::string response = std::format("HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                       "Content-Length: {}\r\nConnection: close\r\n\r\n{}", body.size(), body);
+    size_t sent = 0;
+    while (sent < response.size()) {
+        ssize_t count = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (count <= 0) {
+            break;
+        }
+        sent += count;
+    }
+}
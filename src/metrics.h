@@ -0,0 +1,72 @@
+#ifndef CHIP8_METRICS_H
+#define CHIP8_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include "chip8.h"
+#include "frame_pacer.h"
+
+//Performance counters shared between the emulation thread, which stores them, and the metrics server, which
+//reads them. Every value is a relaxed atomic, so neither side ever waits for the other.
+class Metrics {
+public:
+    //copies the counters of chip8 and pacer, called by the emulation thread after every frame.
+    //presented is the number of frames shown so far, which is not counted by the pacer in turbo mode
+    void publish(const Chip8 &chip8, const FramePacer &pacer, uint64_t presented);
+
+    //recomputes the instruction rate and frame time percentiles, called by the emulation thread about once
+    //per second since the percentiles walk the whole histogram
+    void publish_rates(const Chip8 &chip8, const FramePacer &pacer);
+
+    //all metrics in the Prometheus text exposition format
+    std::string prometheus_text() const;
+
+private:
+    std::atomic<uint64_t> instructions{0};
+    std::atomic<double> instructions_per_second{0};
+    std::atomic<uint64_t> frames_presented{0};
+    std::atomic<uint64_t> frames_dropped{0};
+    std::atomic<double> frame_time_p50{0};
+    std::atomic<double> frame_time_p90{0};
+    std::atomic<double> frame_time_p99{0};
+    //_sum and _count of the summary, both taken from the same histogram at the same time
+    std::atomic<double> frame_time_sum{0};
+    std::atomic<uint64_t> frame_time_count{0};
+    std::atomic<uint64_t> audio_underruns{0};
+    std::atomic<uint64_t> unknown_opcodes{0};
+    std::atomic<int> stack_high_water{0};
+
+    //emulation thread only
+    uint64_t rate_instructions = 0;
+    std::chrono::steady_clock::time_point rate_start = std::chrono::steady_clock::now();
+};
+
+//Serves Metrics over HTTP on 127.0.0.1 from its own thread, for scraping by Prometheus. Every request gets
+//the metrics, whatever its path.
+class MetricsServer {
+public:
+    MetricsServer(const Metrics &_metrics, int port);
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer &) = delete;
+    MetricsServer &operator=(const MetricsServer &) = delete;
+
+    //false if the port could not be opened
+    bool is_open() const { return listen_fd >= 0; }
+
+private:
+    const Metrics &metrics;
+    int listen_fd = -1;
+    std::atomic<bool> stopping{false};
+    std::thread thread;
+
+    void serve();
+
+    void respond(int client);
+};
+
+
+#endif //CHIP8_METRICS_H
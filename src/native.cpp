@@ -0,0 +1,23 @@
+#include "native.h"
+#include <cstring>
+#include <vector>
+
+//a function local static, so registration works regardless of the order static initialisers run in
+static std::vector<NativeROM> &registry() {
+    static std::vector<NativeROM> roms;
+    return roms;
+}
+
+bool register_native_rom(const NativeROM &rom) {
+    registry().push_back(rom);
+    return true;
+}
+
+const NativeROM *find_native_rom(const uint8_t *image, size_t size) {
+    for (const NativeROM &rom: registry()) {
+        if (rom.size == size && memcmp(rom.image, image, size) == 0) {
+            return &rom;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,31 @@
+#ifndef CHIP8_NATIVE_H
+#define CHIP8_NATIVE_H
+
+#include <cstddef>
+#include <cstdint>
+#include "chip8_state.h"
+
+//Runs translated instructions starting at state.PC until budget instructions have run, an instruction draws,
+//or PC reaches an instruction the translation leaves to the interpreter. Returns the number of instructions run,
+//0 meaning the interpreter has to execute the instruction at state.PC.
+using NativeFunc = int (*)(Chip8State &state, int budget);
+
+//a ROM image translated by chip8-aot
+struct NativeROM {
+    const char *name;
+    const uint8_t *image;
+    size_t size;
+    NativeFunc run;
+    //lowest and highest address of the translated instructions
+    uint16_t code_low;
+    uint16_t code_high;
+};
+
+//called from the static initialiser of each generated translation unit
+bool register_native_rom(const NativeROM &rom);
+
+//the translation of exactly this image, or nullptr
+const NativeROM *find_native_rom(const uint8_t *image, size_t size);
+
+
+#endif //CHIP8_NATIVE_H
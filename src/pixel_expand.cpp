@@ -0,0 +1,168 @@
+#include "pixel_expand.h"
+#include <sstream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CHIP8_X86 1
+#include <immintrin.h>
+#endif
+
+
+bool parse_palette(const std::string &str, Palette &palette) {
+    Palette parsed = palette;
+    std::stringstream ss(str);
+    std::string color;
+    int count = 0;
+
+    while (std::getline(ss, color, ',')) {
+        if (count >= PALETTE_SIZE || color.size() != 6 ||
+            color.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) {
+            return false;
+        }
+        parsed.colors[count++] = (std::stoul(color, nullptr, 16) << 8) | 0xFF;
+    }
+
+    if (count != 2 && count != PALETTE_SIZE) {
+        return false;
+    }
+    palette = parsed;
+    return true;
+}
+
+
+static void expand_row_scalar(const uint8_t *src, uint32_t *dst, int width, uint8_t mask, const Palette &palette) {
+    for (int i = 0; i < width; ++i) {
+        dst[i] = palette.colors[src[i] & mask];
+    }
+}
+
+#ifdef CHIP8_X86
+
+//SSE2 has no variable permute, so pick between colour pairs using each index bit as a select mask
+__attribute__((target("sse2")))
+static inline __m128i select_sse2(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_andnot_si128(mask, a), _mm_and_si128(mask, b));
+}
+
+__attribute__((target("sse2")))
+static inline void store_select_sse2(uint32_t *dst, __m128i bit0, __m128i bit1,
+                                     __m128i c0, __m128i c1, __m128i c2, __m128i c3) {
+    __m128i out = select_sse2(bit1, select_sse2(bit0, c0, c1), select_sse2(bit0, c2, c3));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), out);
+}
+
+__attribute__((target("sse2")))
+static void expand_row_sse2(const uint8_t *src, uint32_t *dst, int width, uint8_t mask, const Palette &palette) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i index_mask = _mm_set1_epi8(static_cast<char>(mask));
+    const __m128i c0 = _mm_set1_epi32(static_cast<int>(palette.colors[0]));
+    const __m128i c1 = _mm_set1_epi32(static_cast<int>(palette.colors[1]));
+    const __m128i c2 = _mm_set1_epi32(static_cast<int>(palette.colors[2]));
+    const __m128i c3 = _mm_set1_epi32(static_cast<int>(palette.colors[3]));
+
+    int i = 0;
+    for (; i + 16 <= width; i += 16) {
+        __m128i bytes = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)), index_mask);
+        //shift each index bit into the sign bit of its byte and widen the sign to a full 32 bit lane mask
+        __m128i bit0 = _mm_cmpgt_epi8(zero, _mm_slli_epi16(bytes, 7));
+        __m128i bit1 = _mm_cmpgt_epi8(zero, _mm_slli_epi16(bytes, 6));
+        __m128i bit0_lo = _mm_unpacklo_epi8(bit0, bit0), bit0_hi = _mm_unpackhi_epi8(bit0, bit0);
+        __m128i bit1_lo = _mm_unpacklo_epi8(bit1, bit1), bit1_hi = _mm_unpackhi_epi8(bit1, bit1);
+
+        store_select_sse2(dst + i, _mm_unpacklo_epi16(bit0_lo, bit0_lo), _mm_unpacklo_epi16(bit1_lo, bit1_lo),
+                          c0, c1, c2, c3);
+        store_select_sse2(dst + i + 4, _mm_unpackhi_epi16(bit0_lo, bit0_lo), _mm_unpackhi_epi16(bit1_lo, bit1_lo),
+                          c0, c1, c2, c3);
+        store_select_sse2(dst + i + 8, _mm_unpacklo_epi16(bit0_hi, bit0_hi), _mm_unpacklo_epi16(bit1_hi, bit1_hi),
+                          c0, c1, c2, c3);
+        store_select_sse2(dst + i + 12, _mm_unpackhi_epi16(bit0_hi, bit0_hi), _mm_unpackhi_epi16(bit1_hi, bit1_hi),
+                          c0, c1, c2, c3);
+    }
+
+    expand_row_scalar(src + i, dst + i, width - i, mask, palette);
+}
+
+//AVX2 can look the colour up directly with a lane permute, the palette is repeated in both halves of the register
+__attribute__((target("avx2")))
+static void expand_row_avx2(const uint8_t *src, uint32_t *dst, int width, uint8_t mask, const Palette &palette) {
+    const __m256i index_mask = _mm256_set1_epi32(mask);
+    const __m256i colors = _mm256_setr_epi32(
+            static_cast<int>(palette.colors[0]), static_cast<int>(palette.colors[1]),
+            static_cast<int>(palette.colors[2]), static_cast<int>(palette.colors[3]),
+            static_cast<int>(palette.colors[0]), static_cast<int>(palette.colors[1]),
+            static_cast<int>(palette.colors[2]), static_cast<int>(palette.colors[3]));
+
+    int i = 0;
+    for (; i + 32 <= width; i += 32) {
+        for (int q = 0; q < 4; ++q) {
+            __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i + q * 8));
+            __m256i idx = _mm256_and_si256(_mm256_cvtepu8_epi32(bytes), index_mask);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i + q * 8),
+                                _mm256_permutevar8x32_epi32(colors, idx));
+        }
+    }
+    for (; i + 8 <= width; i += 8) {
+        __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i));
+        __m256i idx = _mm256_and_si256(_mm256_cvtepu8_epi32(bytes), index_mask);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_permutevar8x32_epi32(colors, idx));
+    }
+
+    expand_row_scalar(src + i, dst + i, width - i, mask, palette);
+}
+
+#endif
+
+
+bool expand_kernel_supported(ExpandKernel kernel) {
+    switch (kernel) {
+        case ExpandKernel::Scalar:
+            return true;
+#ifdef CHIP8_X86
+        case ExpandKernel::SSE2:
+            return __builtin_cpu_supports("sse2");
+        case ExpandKernel::AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+ExpandKernel best_expand_kernel() {
+    if (expand_kernel_supported(ExpandKernel::AVX2)) return ExpandKernel::AVX2;
+    if (expand_kernel_supported(ExpandKernel::SSE2)) return ExpandKernel::SSE2;
+    return ExpandKernel::Scalar;
+}
+
+const char *expand_kernel_name(ExpandKernel kernel) {
+    switch (kernel) {
+        case ExpandKernel::SSE2:
+            return "sse2";
+        case ExpandKernel::AVX2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
+
+void expand_pixels(const uint8_t *display, int width, int height, int planes, const Palette &palette,
+                   uint32_t *dst, int pitch, ExpandKernel kernel) {
+    using RowFunc = void (*)(const uint8_t *, uint32_t *, int, uint8_t, const Palette &);
+    RowFunc row = expand_row_scalar;
+#ifdef CHIP8_X86
+    if (kernel == ExpandKernel::AVX2) row = expand_row_avx2;
+    else if (kernel == ExpandKernel::SSE2) row = expand_row_sse2;
+#endif
+
+    uint8_t mask = (1 << planes) - 1;
+
+    //a tightly packed destination can be treated as one long row
+    if (pitch == width * static_cast<int>(sizeof(uint32_t))) {
+        row(display, dst, width * height, mask, palette);
+        return;
+    }
+
+    for (int y = 0; y < height; ++y) {
+        row(display + y * width, reinterpret_cast<uint32_t *>(reinterpret_cast<uint8_t *>(dst) + y * pitch),
+            width, mask, palette);
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef CHIP8_PIXEL_EXPAND_H
+#define CHIP8_PIXEL_EXPAND_H
+
+#include <cstdint>
+#include <string>
+
+//each display byte holds one bit per plane, so up to 2 planes index into a 4 colour palette
+const int PALETTE_SIZE = 4;
+
+struct Palette {
+    //colours are in SDL_PIXELFORMAT_RGBA8888 order, i.e. 0xRRGGBBAA
+    uint32_t colors[PALETTE_SIZE];
+};
+
+constexpr Palette DEFAULT_PALETTE = {{0x000000FF, 0xFFFFFFFF, 0xAAAAAAFF, 0x555555FF}};
+
+enum class ExpandKernel {
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+//parses a comma separated list of 2 or 4 RRGGBB hex colours
+bool parse_palette(const std::string &str, Palette &palette);
+
+//the fastest kernel the current CPU supports
+ExpandKernel best_expand_kernel();
+
+bool expand_kernel_supported(ExpandKernel kernel);
+
+const char *expand_kernel_name(ExpandKernel kernel);
+
+//maps width * height display bytes through the palette into dst, which is pitch bytes per row.
+//planes is 1 or 2, bits above the plane count are ignored
+void expand_pixels(const uint8_t *display, int width, int height, int planes, const Palette &palette,
+                   uint32_t *dst, int pitch, ExpandKernel kernel);
+
+inline void expand_pixels(const uint8_t *display, int width, int height, int planes, const Palette &palette,
+                          uint32_t *dst, int pitch) {
+    static const ExpandKernel kernel = best_expand_kernel();
+    expand_pixels(display, width, height, planes, palette, dst, pitch, kernel);
+}
+
+
+#endif //CHIP8_PIXEL_EXPAND_H
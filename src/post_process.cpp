@@ -0,0 +1,111 @@
+#include "post_process.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CHIP8_X86 1
+#include <immintrin.h>
+#endif
+
+
+PostProcessor::PostProcessor(int _width, int _height, const PostProcessSettings &_settings)
+        : width(_width), height(_height), settings(_settings) {
+    settings.scale = std::max(settings.scale, 1);
+
+    if (settings.phosphor_frames > 0) {
+        //pick the per frame factor so a fully lit channel is below 1 after phosphor_frames frames. Long fades
+        //round up to 256, which would never fade at all, so they are capped at the slowest fade there is
+        double retention = std::pow(1.0 / 255.0, 1.0 / settings.phosphor_frames);
+        decay = static_cast<uint16_t>(std::min(std::lround(retention * 256), 255L));
+    }
+
+    persistence.resize(width * height, 0);
+    scanline_row.resize(output_width(), 0);
+}
+
+void PostProcessor::process(const uint32_t *frame, uint32_t *dst, int pitch) {
+    auto start = std::chrono::steady_clock::now();
+
+    blend(frame);
+    upscale(dst, pitch);
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    timings.record(elapsed);
+    if (std::chrono::duration<double, std::milli>(elapsed).count() > POST_PROCESS_BUDGET_MS) {
+        over_budget++;
+    }
+}
+
+void PostProcessor::blend(const uint32_t *frame) {
+    int count = width * height;
+
+    if (decay == 0) {
+        memcpy(persistence.data(), frame, count * sizeof(uint32_t));
+        fading = false;
+        return;
+    }
+
+    //each channel becomes max(new, old * decay), so lit pixels show at full brightness and fade when erased
+    auto *old = reinterpret_cast<uint8_t *>(persistence.data());
+    auto *cur = reinterpret_cast<const uint8_t *>(frame);
+    int bytes = count * static_cast<int>(sizeof(uint32_t));
+    int i = 0;
+    bool changed = false;
+
+#ifdef CHIP8_X86
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i factor = _mm_set1_epi16(static_cast<short>(decay));
+    __m128i differs = _mm_setzero_si128();
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i prev = _mm_loadu_si128(reinterpret_cast<const __m128i *>(old + i));
+        __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur + i));
+        __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(prev, zero), factor), 8);
+        __m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(prev, zero), factor), 8);
+        __m128i out = _mm_max_epu8(_mm_packus_epi16(lo, hi), next);
+        differs = _mm_or_si128(differs, _mm_xor_si128(out, next));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(old + i), out);
+    }
+    changed = _mm_movemask_epi8(_mm_cmpeq_epi8(differs, zero)) != 0xFFFF;
+#endif
+
+    for (; i < bytes; ++i) {
+        auto out = static_cast<uint8_t>(std::max<int>((old[i] * decay) >> 8, cur[i]));
+        changed |= out != cur[i];
+        old[i] = out;
+    }
+
+    fading = changed;
+}
+
+void PostProcessor::upscale(uint32_t *dst, int pitch) {
+    int scale = settings.scale;
+    int out_width = output_width();
+    bool scanlines = settings.scanlines && scale > 1;
+    auto *out = reinterpret_cast<uint8_t *>(dst);
+    size_t row_bytes = out_width * sizeof(uint32_t);
+
+    for (int y = 0; y < height; ++y) {
+        auto *first = reinterpret_cast<uint32_t *>(out + (y * scale) * pitch);
+        const uint32_t *src = persistence.data() + y * width;
+        for (int x = 0; x < width; ++x) {
+            std::fill_n(first + x * scale, scale, src[x]);
+        }
+
+        //every other row of the scaled pixel is the same, so build it once and copy it down
+        int copies = scanlines ? scale - 1 : scale;
+        for (int r = 1; r < copies; ++r) {
+            memcpy(out + (y * scale + r) * pitch, first, row_bytes);
+        }
+
+        if (scanlines) {
+            //halve the colour channels and keep the alpha, colours are 0xRRGGBBAA
+            for (int x = 0; x < out_width; ++x) {
+                uint32_t color = first[x];
+                scanline_row[x] = ((color >> 1) & 0x7F7F7F00) | (color & 0xFF);
+            }
+            memcpy(out + (y * scale + scale - 1) * pitch, scanline_row.data(), row_bytes);
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef CHIP8_POST_PROCESS_H
+#define CHIP8_POST_PROCESS_H
+
+#include <cstdint>
+#include <vector>
+#include "frame_pacer.h"
+
+//maximum time the post-processing stage may take per frame before it is reported as over budget
+const double POST_PROCESS_BUDGET_MS = 0.5;
+
+struct PostProcessSettings {
+    //number of frames a lit pixel takes to fade out after it is turned off, 0 disables persistence
+    int phosphor_frames = 0;
+
+    //darkens the last row of every scaled pixel
+    bool scanlines = false;
+
+    //integer upscale factor applied on the CPU, 1 leaves scaling to the renderer
+    int scale = 1;
+
+    bool enabled() const { return phosphor_frames > 0 || scanlines || scale > 1; }
+};
+
+//Runs after the palette expansion. Blends the frame with the fading previous frames (phosphor persistence),
+//then upscales by an integer factor with optional scanlines. All buffers are allocated up front.
+class PostProcessor {
+public:
+    PostProcessor(int _width, int _height, const PostProcessSettings &_settings);
+
+    int output_width() const { return width * settings.scale; }
+
+    int output_height() const { return height * settings.scale; }
+
+    //frame is width * height RGBA pixels, dst is output_width() * output_height() with pitch bytes per row
+    void process(const uint32_t *frame, uint32_t *dst, int pitch);
+
+    //true while previously lit pixels are still fading, so the screen has to keep presenting without new draws
+    bool is_fading() const { return fading; }
+
+    const FrameHistogram &frame_times() const { return timings; }
+
+    uint64_t over_budget_frames() const { return over_budget; }
+
+private:
+    int width;
+    int height;
+    PostProcessSettings settings;
+
+    //fixed point 8.8 factor each channel is multiplied by per frame
+    uint16_t decay = 0;
+
+    std::vector<uint32_t> persistence;
+    std::vector<uint32_t> scanline_row;
+    bool fading = false;
+
+    FrameHistogram timings;
+    uint64_t over_budget = 0;
+
+    void blend(const uint32_t *frame);
+
+    void upscale(uint32_t *dst, int pitch);
+};
+
+
+#endif //CHIP8_POST_PROCESS_H
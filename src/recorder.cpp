@@ -0,0 +1,254 @@
+#include "recorder.h"
+#include <array>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include "frame_pacer.h"
+
+static const std::array<uint32_t, 256> CRC_TABLE = [] {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+        }
+        table[i] = c;
+    }
+    return table;
+}();
+
+static uint32_t crc32(const uint8_t *data, size_t length) {
+    uint32_t c = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; ++i) {
+        c = CRC_TABLE[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+    }
+    return c ^ 0xFFFFFFFF;
+}
+
+static uint32_t adler32(const uint8_t *data, size_t length) {
+    //a frame is far below the 5552 bytes after which the sums would have to be reduced while adding
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (size_t i = 0; i < length; ++i) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+static void put_u32(std::vector<uint8_t> &out, uint32_t value) {
+    out.push_back(value >> 24);
+    out.push_back(value >> 16);
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+static void put_chunk(std::vector<uint8_t> &out, const char *type, const uint8_t *data, size_t length) {
+    put_u32(out, length);
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + length);
+    put_u32(out, crc32(out.data() + start, out.size() - start));
+}
+
+FrameRecorder::FrameRecorder(const std::string &_path, const Palette &_palette, int _planes)
+        : path(_path), palette(_palette), planes(_planes), queue(RECORDER_QUEUE_SIZE) {
+    if (path.ends_with(".png")) {
+        format = RecordFormat::PNG;
+        path.resize(path.size() - 4);
+    } else {
+        format = RecordFormat::Y4M;
+        file = path == "-" ? stdout : fopen(path.c_str(), "wb");
+        if (!file) {
+            std::cerr << "ERROR: Could not open " << path << " for recording\n";
+            return;
+        }
+        //C444 keeps the pixel edges sharp, 4:2:0 would smear colour over neighbouring pixels
+        std::string header = std::format("YUV4MPEG2 W{} H{} F{}:1 Ip A1:1 C444\n", LOGICAL_WIDTH, LOGICAL_HEIGHT,
+                                         FRAME_RATE);
+        fwrite(header.data(), 1, header.size(), file);
+    }
+
+    //BT.601 studio range, which is what players assume for a stream without colour information
+    for (int i = 0; i < PALETTE_SIZE; ++i) {
+        int r = (palette.colors[i] >> 24) & 0xFF;
+        int g = (palette.colors[i] >> 16) & 0xFF;
+        int b = (palette.colors[i] >> 8) & 0xFF;
+        yuv[i][0] = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        yuv[i][1] = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        yuv[i][2] = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+
+    open = true;
+    writer = std::thread(&FrameRecorder::writer_loop, this);
+}
+
+FrameRecorder::~FrameRecorder() {
+    finish();
+}
+
+void FrameRecorder::add_frame(const uint8_t *display) {
+    const size_t size = LOGICAL_WIDTH * LOGICAL_HEIGHT;
+    if (!open) {
+        return;
+    }
+    uint64_t number = frame_count++;
+    bool same = number > 0 && memcmp(display, last_frame, size) == 0;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (same || queued == queue.size()) {
+            if (same) {
+                duplicates++;
+            } else {
+                dropped++;
+            }
+            //extend the newest queued frame, or tell the writer to repeat the one it already has
+            if (queued > 0) {
+                queue[(head + queued - 1) % queue.size()].count++;
+                return;
+            }
+            QueuedFrame &frame = queue[head];
+            frame.number = number;
+            frame.count = 1;
+            frame.repeat = true;
+            queued++;
+        } else {
+            QueuedFrame &frame = queue[(head + queued) % queue.size()];
+            memcpy(frame.pixels, display, size);
+            frame.number = number;
+            frame.count = 1;
+            frame.repeat = false;
+            queued++;
+            memcpy(last_frame, display, size);
+        }
+    }
+    queue_cv.notify_one();
+}
+
+void FrameRecorder::finish() {
+    if (!writer.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queue_cv.notify_one();
+    writer.join();
+
+    if (file) {
+        if (fflush(file) != 0 && !write_failed) {
+            std::cerr << "ERROR: Could not write to " << path << "\n";
+        }
+        if (file != stdout) {
+            fclose(file);
+        }
+        file = nullptr;
+    }
+    open = false;
+}
+
+void FrameRecorder::writer_loop() {
+    QueuedFrame frame;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queue_cv.wait(lock, [this] { return stopping || queued > 0; });
+            if (queued == 0) {
+                return;
+            }
+            //copied out so the producer can keep extending the queue while this one is written
+            frame = queue[head];
+            head = (head + 1) % queue.size();
+            queued--;
+        }
+        if (!write_failed) {
+            write_frame(frame);
+        }
+    }
+}
+
+void FrameRecorder::write_frame(const QueuedFrame &frame) {
+    if (format == RecordFormat::Y4M) {
+        if (!frame.repeat) {
+            encode_y4m(frame.pixels);
+        }
+        for (uint32_t i = 0; i < frame.count && !write_failed; ++i) {
+            write_failed = fwrite(encoded.data(), 1, encoded.size(), file) != encoded.size();
+        }
+    } else {
+        //unchanged frames are left out, the gap in the numbering shows how long a frame was on screen
+        if (frame.repeat) {
+            return;
+        }
+        encode_png(frame.pixels);
+        std::string name = std::format("{}_{:06}.png", path, frame.number);
+        FILE *png = fopen(name.c_str(), "wb");
+        write_failed = !png || fwrite(encoded.data(), 1, encoded.size(), png) != encoded.size();
+        if (png && fclose(png) != 0) {
+            write_failed = true;
+        }
+    }
+    if (write_failed) {
+        std::cerr << "ERROR: Could not write to " << path << ", recording stopped\n";
+    }
+}
+
+void FrameRecorder::encode_y4m(const uint8_t *pixels) {
+    const int size = LOGICAL_WIDTH * LOGICAL_HEIGHT;
+    const uint8_t mask = (1 << planes) - 1;
+    static const char FRAME_HEADER[] = "FRAME\n";
+    encoded.resize(sizeof(FRAME_HEADER) - 1 + 3 * size);
+    memcpy(encoded.data(), FRAME_HEADER, sizeof(FRAME_HEADER) - 1);
+    uint8_t *y = encoded.data() + sizeof(FRAME_HEADER) - 1;
+    uint8_t *u = y + size;
+    uint8_t *v = u + size;
+    for (int i = 0; i < size; ++i) {
+        const uint8_t *color = yuv[pixels[i] & mask];
+        y[i] = color[0];
+        u[i] = color[1];
+        v[i] = color[2];
+    }
+}
+
+void FrameRecorder::encode_png(const uint8_t *pixels) {
+    const uint8_t mask = (1 << planes) - 1;
+    //indexed colour with the emulator palette, each row is a filter type byte (0, none) and one byte per pixel
+    const size_t row_size = LOGICAL_WIDTH + 1;
+    uint8_t raw[row_size * LOGICAL_HEIGHT];
+    for (int row = 0; row < LOGICAL_HEIGHT; ++row) {
+        raw[row * row_size] = 0;
+        for (int x = 0; x < LOGICAL_WIDTH; ++x) {
+            raw[row * row_size + 1 + x] = pixels[row * LOGICAL_WIDTH + x] & mask;
+        }
+    }
+
+    //the pixel data is stored without compression in a single deflate block, which keeps encoding cheap enough
+    //for turbo mode, at a few KB per file
+    std::vector<uint8_t> zlib = {0x78, 0x01, 0x01,
+                                 static_cast<uint8_t>(sizeof(raw)), static_cast<uint8_t>(sizeof(raw) >> 8),
+                                 static_cast<uint8_t>(~sizeof(raw)), static_cast<uint8_t>(~sizeof(raw) >> 8)};
+    zlib.insert(zlib.end(), raw, raw + sizeof(raw));
+    put_u32(zlib, adler32(raw, sizeof(raw)));
+
+    uint8_t header[13] = {0};
+    header[3] = LOGICAL_WIDTH;
+    header[7] = LOGICAL_HEIGHT;
+    header[8] = 8;
+    header[9] = 3;
+
+    uint8_t colors[PALETTE_SIZE * 3];
+    for (int i = 0; i < PALETTE_SIZE; ++i) {
+        colors[i * 3] = palette.colors[i] >> 24;
+        colors[i * 3 + 1] = palette.colors[i] >> 16;
+        colors[i * 3 + 2] = palette.colors[i] >> 8;
+    }
+
+    static const uint8_t SIGNATURE[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    encoded.assign(SIGNATURE, SIGNATURE + sizeof(SIGNATURE));
+    put_chunk(encoded, "IHDR", header, sizeof(header));
+    put_chunk(encoded, "PLTE", colors, (mask + 1) * 3);
+    put_chunk(encoded, "IDAT", zlib.data(), zlib.size());
+    put_chunk(encoded, "IEND", nullptr, 0);
+}
@@ -0,0 +1,104 @@
+#ifndef CHIP8_RECORDER_H
+#define CHIP8_RECORDER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "chip8_state.h"
+#include "pixel_expand.h"
+
+//frames that can wait for the writer thread before new ones are dropped, about 4 seconds at 60 Hz
+const int RECORDER_QUEUE_SIZE = 256;
+
+enum class RecordFormat {
+    //one uncompressed YUV4MPEG2 stream at 60 fps, which encoders such as ffmpeg read directly
+    Y4M,
+    //one PNG file per changed frame, numbered by frame so the timing can be recovered
+    PNG
+};
+
+//Writes the display to a video file on a background thread, so the emulation never waits for the disk.
+//Frames are queued as display bytes and converted to colour by the writer. When the queue is full new frames
+//are dropped and counted, and the previous frame is repeated in their place so the video keeps its timing.
+class FrameRecorder {
+public:
+    //path ending in .png writes path_000000.png, path_000001.png, ... (without the extension),
+    //anything else is a Y4M file, and "-" writes Y4M to stdout
+    FrameRecorder(const std::string &path, const Palette &_palette, int _planes);
+    ~FrameRecorder();
+
+    FrameRecorder(const FrameRecorder &) = delete;
+    FrameRecorder &operator=(const FrameRecorder &) = delete;
+
+    //false if the output could not be opened
+    bool is_open() const { return open; }
+
+    RecordFormat record_format() const { return format; }
+
+    //adds one 60 Hz frame of LOGICAL_WIDTH * LOGICAL_HEIGHT display bytes. Never blocks on the writer
+    void add_frame(const uint8_t *display);
+
+    //waits until every queued frame is written and closes the output
+    void finish();
+
+    uint64_t frames_added() const { return frame_count; }
+
+    //frames that only repeat the previous one, which are not queued again
+    uint64_t duplicate_frames() const { return duplicates; }
+
+    uint64_t dropped_frames() const { return dropped; }
+
+private:
+    struct QueuedFrame {
+        uint8_t pixels[LOGICAL_WIDTH * LOGICAL_HEIGHT];
+        //frame number of the first time this frame was shown
+        uint64_t number;
+        //how many frames in a row it is shown for
+        uint32_t count;
+        //true if this repeats the frame before it, pixels are not filled in
+        bool repeat;
+    };
+
+    std::string path;
+    RecordFormat format;
+    Palette palette;
+    int planes;
+    bool open = false;
+    FILE *file = nullptr;
+
+    //ring buffer, allocated up front so queueing a frame is a copy and nothing else
+    std::vector<QueuedFrame> queue;
+    size_t head = 0;
+    size_t queued = 0;
+    std::mutex mutex;
+    std::condition_variable queue_cv;
+    bool stopping = false;
+    std::thread writer;
+
+    //producer side, only touched by the thread calling add_frame
+    uint8_t last_frame[LOGICAL_WIDTH * LOGICAL_HEIGHT] = {0};
+    uint64_t frame_count = 0;
+    uint64_t duplicates = 0;
+    uint64_t dropped = 0;
+
+    //writer side, the last frame converted to the output format, reused for repeats
+    std::vector<uint8_t> encoded;
+    //palette colours as Y, Cb, Cr
+    uint8_t yuv[PALETTE_SIZE][3];
+    bool write_failed = false;
+
+    void writer_loop();
+
+    void write_frame(const QueuedFrame &frame);
+
+    void encode_y4m(const uint8_t *pixels);
+
+    void encode_png(const uint8_t *pixels);
+};
+
+
+#endif //CHIP8_RECORDER_H
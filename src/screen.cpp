@@ -1,46 +1,92 @@
 #include "screen.h"
 #include "chip8.h"
 
-Screen::Screen() {
+Screen::Screen(const Palette &_palette, const PostProcessSettings &post_settings) : palette(_palette) {
+    int texture_width = LOGICAL_WIDTH;
+    int texture_height = LOGICAL_HEIGHT;
+    if (post_settings.enabled()) {
+        post = std::make_unique<PostProcessor>(LOGICAL_WIDTH, LOGICAL_HEIGHT, post_settings);
+        frame.resize(LOGICAL_WIDTH * LOGICAL_HEIGHT);
+        texture_width = post->output_width();
+        texture_height = post->output_height();
+    }
+
+
     window = SDL_CreateWindow("CHIP-8",
                               WINDOW_WIDTH,
                               WINDOW_HEIGHT, 0);
     renderer = SDL_CreateRenderer(window, nullptr);
 
-    //setting the logical size lets us just treat it as a 64 x 32 display, and it will automatically scale it up
-    SDL_SetRenderLogicalPresentation(renderer, LOGICAL_WIDTH, LOGICAL_HEIGHT, SDL_LOGICAL_PRESENTATION_LETTERBOX);
+    //setting the logical size lets us just treat it as a 64 x 32 display, and it will automatically scale it up.
+    //when post-processing upscales on the CPU the logical size is the scaled size instead
+    SDL_SetRenderLogicalPresentation(renderer, texture_width, texture_height, SDL_LOGICAL_PRESENTATION_LETTERBOX);
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
     SDL_RenderClear(renderer);
 
     texture = SDL_CreateTexture(renderer,
                                 SDL_PIXELFORMAT_RGBA8888,
-                                SDL_TEXTUREACCESS_STATIC,
-                                LOGICAL_WIDTH,
-                                LOGICAL_HEIGHT);
+                                SDL_TEXTUREACCESS_STREAMING,
+                                texture_width,
+                                texture_height);
     SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_NEAREST);
 }
 
 Screen::~Screen() {
+    if (heatmap) {
+        SDL_DestroyTexture(heatmap);
+    }
     SDL_DestroyWindow(window);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyTexture(texture);
-    SDL_Quit();
-
 }
 
 void Screen::draw(const uint8_t *display) {
-    uint32_t screen[LOGICAL_WIDTH * LOGICAL_HEIGHT];
-
-    for (int i = 0; i < LOGICAL_WIDTH * LOGICAL_HEIGHT; i++) {
-        screen[i] = (display[i] == 1) ? UINT32_MAX : 0;
+    //expand straight into the texture memory instead of going through a staging buffer
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(texture, nullptr, &pixels, &pitch)) {
+        if (post) {
+            expand_pixels(display, LOGICAL_WIDTH, LOGICAL_HEIGHT, planes, palette, frame.data(),
+                          LOGICAL_WIDTH * sizeof(uint32_t));
+            post->process(frame.data(), static_cast<uint32_t *>(pixels), pitch);
+        } else {
+            expand_pixels(display, LOGICAL_WIDTH, LOGICAL_HEIGHT, planes, palette, static_cast<uint32_t *>(pixels),
+                          pitch);
+        }
+        SDL_UnlockTexture(texture);
     }
 
     //clear renderer before drawing
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
     SDL_RenderClear(renderer);
 
-    SDL_UpdateTexture(texture, nullptr, screen, LOGICAL_WIDTH * sizeof(uint32_t));
-    SDL_FRect position = {0, 0, LOGICAL_WIDTH, LOGICAL_HEIGHT};
-    SDL_RenderTexture(renderer, texture, nullptr, &position);
+    SDL_RenderTexture(renderer, texture, nullptr, nullptr);
+    if (heatmap) {
+        SDL_RenderTexture(renderer, heatmap, nullptr, nullptr);
+    }
     SDL_RenderPresent(renderer);
-}
\ No newline at end of file
+}
+
+void Screen::set_heatmap(const uint32_t *pixels) {
+    if (!pixels) {
+        if (heatmap) {
+            SDL_DestroyTexture(heatmap);
+            heatmap = nullptr;
+        }
+        return;
+    }
+
+    //always at the display resolution, the renderer stretches it over the post-processed texture
+    if (!heatmap) {
+        heatmap = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
+                                    LOGICAL_WIDTH, LOGICAL_HEIGHT);
+        SDL_SetTextureScaleMode(heatmap, SDL_SCALEMODE_NEAREST);
+        SDL_SetTextureBlendMode(heatmap, SDL_BLENDMODE_BLEND);
+    }
+    SDL_UpdateTexture(heatmap, nullptr, pixels, LOGICAL_WIDTH * sizeof(uint32_t));
+}
+
+void Screen::set_overlay(const std::string &text) {
+    std::string title = text.empty() ? "CHIP-8" : "CHIP-8 | " + text;
+    SDL_SetWindowTitle(window, title.c_str());
+}
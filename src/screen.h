@@ -2,21 +2,47 @@
 #define CHIP8_DISPLAY_H
 
 #include <SDL3/SDL.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "pixel_expand.h"
+#include "post_process.h"
 
 const int WINDOW_WIDTH = 640;
 const int WINDOW_HEIGHT = 320;
 
 class Screen {
 public:
-    Screen();
+    Screen() : Screen(DEFAULT_PALETTE) {}
+    explicit Screen(const Palette &_palette) : Screen(_palette, PostProcessSettings()) {}
+    Screen(const Palette &_palette, const PostProcessSettings &post_settings);
     ~Screen();
     void draw(const uint8_t *display);
+    void set_overlay(const std::string &text);
+
+    //number of display bitplanes used to index the palette
+    void set_planes(int _planes) { planes = _planes; }
+
+    //blends LOGICAL_WIDTH * LOGICAL_HEIGHT RGBA8888 pixels over the display, e.g. a memory heatmap.
+    //The pixels are copied, nullptr removes the overlay
+    void set_heatmap(const uint32_t *pixels);
+
+    //true if the screen needs to be redrawn even when the display has not changed
+    bool is_animating() const { return (post && post->is_fading()) || heatmap; }
+
+    const PostProcessor *post_processor() const { return post.get(); }
 
 private:
     SDL_Window *window;
     SDL_Renderer *renderer;
     SDL_Texture *texture;
+    SDL_Texture *heatmap = nullptr;
+
+    Palette palette;
+    int planes = 1;
 
+    std::unique_ptr<PostProcessor> post;
+    std::vector<uint32_t> frame;
 };
 
 
@@ -0,0 +1,153 @@
+#include "wall.h"
+#include <algorithm>
+#include <format>
+
+
+Wall::Wall(int _cols, int _rows, const std::vector<std::string> &roms, bool exit_on_unknown, bool increment_I,
+           int _ipf, const Palette &_palette, bool idle_skip)
+        : cols(_cols), rows(_rows), ipf(_ipf), palette(_palette),
+          pool(std::min(static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u)), _cols * _rows)) {
+    tiles.resize(cols * rows);
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        tiles[i].rom = roms[i % roms.size()];
+        //only one instance could own the audio device, so the wall is silent
+        tiles[i].chip8 = std::make_unique<Chip8>(tiles[i].rom, false, exit_on_unknown, increment_I, false);
+        tiles[i].chip8->set_idle_skip(idle_skip);
+    }
+
+    int atlas_width = cols * LOGICAL_WIDTH;
+    int atlas_height = rows * LOGICAL_HEIGHT;
+
+    window = SDL_CreateWindow("CHIP-8 Wall", atlas_width * WALL_TILE_SCALE, atlas_height * WALL_TILE_SCALE,
+                              SDL_WINDOW_RESIZABLE);
+    renderer = SDL_CreateRenderer(window, nullptr);
+    SDL_SetRenderLogicalPresentation(renderer, atlas_width, atlas_height, SDL_LOGICAL_PRESENTATION_LETTERBOX);
+
+    atlas = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
+                              atlas_width, atlas_height);
+    SDL_SetTextureScaleMode(atlas, SDL_SCALEMODE_NEAREST);
+}
+
+Wall::~Wall() {
+    SDL_DestroyTexture(atlas);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+}
+
+bool Wall::is_running() const {
+    return !quit && std::any_of(tiles.begin(), tiles.end(), [](const Tile &tile) {
+        return tile.chip8->isRunning();
+    });
+}
+
+void Wall::poll_events() {
+    //the tiles do not take input, so only quitting is handled here
+    SDL_Event e;
+    while (SDL_PollEvent(&e)) {
+        if (e.type == SDL_EVENT_QUIT || (e.type == SDL_EVENT_KEY_UP && e.key.scancode == EXIT_BUTTON)) {
+            quit = true;
+        }
+    }
+}
+
+void Wall::run(FramePacer &pacer, bool frame_stats) {
+    start = std::chrono::steady_clock::now();
+    auto last_overlay = start;
+    uint64_t last_instructions = 0;
+
+    while (is_running()) {
+        poll_events();
+
+        int ticks = pacer.begin_frame();
+        for (int tick = 0; tick < ticks; ++tick) {
+            pacer.timer_tick();
+        }
+
+        //the atlas stays locked while the workers run, each tile only writes to its own region
+        void *pixels = nullptr;
+        int pitch = 0;
+        if (!SDL_LockTexture(atlas, nullptr, &pixels, &pitch)) {
+            pixels = nullptr;
+        }
+
+        pool.run(static_cast<int>(tiles.size()), [&](int i) {
+            Tile &tile = tiles[i];
+            //stopped machines are not run, but their last display is still drawn below
+            bool running = tile.chip8->isRunning();
+
+            auto tile_start = std::chrono::steady_clock::now();
+            if (running) {
+                for (int tick = 0; tick < ticks; ++tick) {
+                    tile.chip8->decrement_timers();
+                    tile.chip8->run_frame(ipf);
+                }
+            }
+
+            //locking a streaming texture does not keep its old contents, so every tile is redrawn each frame
+            tile.chip8->take_draw_flag();
+            if (pixels) {
+                int x = (i % cols) * LOGICAL_WIDTH;
+                int y = (i / cols) * LOGICAL_HEIGHT;
+                auto *dst = reinterpret_cast<uint32_t *>(static_cast<uint8_t *>(pixels) + y * pitch) + x;
+                expand_pixels(tile.chip8->get_display(), LOGICAL_WIDTH, LOGICAL_HEIGHT, 1, palette, dst, pitch);
+            }
+            if (running) {
+                tile.frame_times.record(std::chrono::steady_clock::now() - tile_start);
+            }
+        });
+
+        if (pixels) {
+            SDL_UnlockTexture(atlas);
+        }
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+        SDL_RenderClear(renderer);
+        SDL_RenderTexture(renderer, atlas, nullptr, nullptr);
+        SDL_RenderPresent(renderer);
+
+        auto now = std::chrono::steady_clock::now();
+        if (frame_stats && now - last_overlay >= std::chrono::seconds(1)) {
+            uint64_t instructions = total_instructions();
+            double seconds = std::chrono::duration<double>(now - last_overlay).count();
+            std::string title = std::format("CHIP-8 Wall | {:.0f} instructions/s | {}",
+                                            (instructions - last_instructions) / seconds, pacer.overlay());
+            SDL_SetWindowTitle(window, title.c_str());
+            last_instructions = instructions;
+            last_overlay = now;
+        }
+
+        pacer.wait();
+    }
+
+    end = std::chrono::steady_clock::now();
+}
+
+uint64_t Wall::total_instructions() const {
+    uint64_t total = 0;
+    for (const Tile &tile: tiles) {
+        total += tile.chip8->instructions_executed();
+    }
+    return total;
+}
+
+uint64_t Wall::total_skipped() const {
+    uint64_t total = 0;
+    for (const Tile &tile: tiles) {
+        total += tile.chip8->instructions_skipped();
+    }
+    return total;
+}
+
+std::string Wall::report() const {
+    double seconds = std::chrono::duration<double>(end - start).count();
+    uint64_t instructions = total_instructions();
+
+    std::string out = std::format("Wall:           {}x{} tiles on {} threads, {} instructions in {:.3f}s ({:.0f}/s)\n",
+                                  cols, rows, pool.size(), instructions, seconds,
+                                  seconds > 0 ? instructions / seconds : 0);
+    out += std::format("Idle skip:      {} instructions skipped ({:.3f}s of emulated time)\n",
+                       total_skipped(), static_cast<double>(total_skipped()) / ipf / FRAME_RATE);
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        out += std::format("Tile {:>3} {}: {}\n", i, tiles[i].rom, tiles[i].frame_times.summary());
+    }
+    return out;
+}
@@ -0,0 +1,63 @@
+#ifndef CHIP8_WALL_H
+#define CHIP8_WALL_H
+
+#include <SDL3/SDL.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "chip8.h"
+#include "frame_pacer.h"
+#include "pixel_expand.h"
+#include "worker_pool.h"
+
+//each tile is drawn at this multiple of the logical resolution in the initial window
+const int WALL_TILE_SCALE = 4;
+
+//Runs a grid of independent machines in one window. Every frame the machines are advanced on a worker pool,
+//each tile is expanded into its region of one atlas texture, and the atlas is presented once.
+class Wall {
+public:
+    //roms are assigned to tiles in order and repeated if there are fewer roms than tiles
+    Wall(int _cols, int _rows, const std::vector<std::string> &roms, bool exit_on_unknown, bool increment_I,
+         int _ipf, const Palette &_palette, bool idle_skip);
+    ~Wall();
+
+    //false if none of the roms could be loaded
+    bool is_running() const;
+
+    void run(FramePacer &pacer, bool frame_stats);
+
+    std::string report() const;
+
+private:
+    struct Tile {
+        std::unique_ptr<Chip8> chip8;
+        std::string rom;
+        FrameHistogram frame_times;
+    };
+
+    int cols;
+    int rows;
+    int ipf;
+    Palette palette;
+
+    std::vector<Tile> tiles;
+    WorkerPool pool;
+
+    SDL_Window *window = nullptr;
+    SDL_Renderer *renderer = nullptr;
+    SDL_Texture *atlas = nullptr;
+
+    bool quit = false;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end;
+
+    void poll_events();
+
+    uint64_t total_instructions() const;
+
+    uint64_t total_skipped() const;
+};
+
+
+#endif //CHIP8_WALL_H
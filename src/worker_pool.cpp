@@ -0,0 +1,72 @@
+#include "worker_pool.h"
+
+
+WorkerPool::WorkerPool(int thread_count) {
+    for (int i = 1; i < thread_count; ++i) {
+        threads.emplace_back(&WorkerPool::worker_loop, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    start_cv.notify_all();
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::run(int count, const std::function<void(int)> &job) {
+    if (threads.empty() || count <= 1) {
+        for (int i = 0; i < count; ++i) {
+            job(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current_job = &job;
+        job_count = count;
+        next_index = 0;
+        active_workers = static_cast<int>(threads.size());
+        generation++;
+    }
+    start_cv.notify_all();
+
+    run_jobs();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cv.wait(lock, [this] { return active_workers == 0; });
+    current_job = nullptr;
+}
+
+void WorkerPool::run_jobs() {
+    for (int i = next_index++; i < job_count; i = next_index++) {
+        (*current_job)(i);
+    }
+}
+
+void WorkerPool::worker_loop() {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_cv.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+
+        run_jobs();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            active_workers--;
+        }
+        done_cv.notify_one();
+    }
+}
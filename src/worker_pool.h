@@ -0,0 +1,46 @@
+#ifndef CHIP8_WORKER_POOL_H
+#define CHIP8_WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//A fixed set of threads that run batches of independent jobs. The calling thread takes part in every batch,
+//so a pool of size 1 runs everything inline.
+class WorkerPool {
+public:
+    explicit WorkerPool(int thread_count);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    //calls job(i) for every i in [0, count) and returns once all of them are done
+    void run(int count, const std::function<void(int)> &job);
+
+    int size() const { return static_cast<int>(threads.size()) + 1; }
+
+private:
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable start_cv;
+    std::condition_variable done_cv;
+
+    const std::function<void(int)> *current_job = nullptr;
+    int job_count = 0;
+    std::atomic<int> next_index{0};
+    int active_workers = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+
+    void worker_loop();
+
+    void run_jobs();
+};
+
+
+#endif //CHIP8_WORKER_POOL_H
@@ -0,0 +1,492 @@
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <getopt.h>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../src/chip8_state.h"
+
+//Ahead-of-time translator from a ROM image to a C++ translation unit that runs on Chip8State.
+//Every instruction reachable from PROGRAM_START becomes a label and control flow between them becomes gotos,
+//so PC is only looked up in a switch after 00EE and BNNN, whose targets are not known until run time.
+//Instructions that need the interpreter (timers and keys, random numbers, unknown opcodes) end the native code,
+//and the interpreter carries on from there.
+//Usage: chip8-aot input.ch8 -o output.cpp [-n name]
+
+struct Instruction {
+    uint16_t opcode = 0;
+    //false if the interpreter has to execute this instruction
+    bool native = false;
+    //addresses control can continue at, other than through the dispatch switch
+    std::vector<uint16_t> successors;
+};
+
+static std::string hex(int address) {
+    return std::format("{:03X}", address);
+}
+
+static bool is_native(uint16_t opcode) {
+    uint8_t N = opcode & 0x000F;
+    uint8_t NN = opcode & 0x00FF;
+    switch (opcode >> 12) {
+        case 0x0:
+            return opcode == 0x00E0 || opcode == 0x00EE;
+        case 0x5:
+        case 0x9:
+            return N == 0;
+        case 0x8:
+            return N <= 0x7 || N == 0xE;
+        //CXNN needs the interpreter's random number generator, and EX9E/EXA1 record input latency
+        case 0xC:
+        case 0xE:
+            return false;
+        //FX07 and FX0A are left to the interpreter so it can detect idle loops
+        case 0xF:
+            return NN == 0x15 || NN == 0x18 || NN == 0x1E || NN == 0x29 || NN == 0x33 || NN == 0x55 || NN == 0x65;
+        default:
+            return true;
+    }
+}
+
+class Translator {
+public:
+    Translator(std::vector<uint8_t> _image, std::string _name) : image(std::move(_image)), name(std::move(_name)) {}
+
+    void analyse();
+
+    std::string generate() const;
+
+    size_t instruction_count() const { return instructions.size(); }
+
+    size_t native_count() const;
+
+private:
+    std::vector<uint8_t> image;
+    std::string name;
+
+    std::map<uint16_t, Instruction> instructions;
+    //instructions reached by a jump, skip or call rather than only by falling through
+    std::set<uint16_t> leaders;
+
+    bool in_image(int address) const {
+        return address >= PROGRAM_START && address + 1 < PROGRAM_START + static_cast<int>(image.size());
+    }
+
+    uint16_t opcode_at(int address) const {
+        return image[address - PROGRAM_START] << 8 | image[address - PROGRAM_START + 1];
+    }
+
+    bool falls_through(uint16_t address) const;
+
+    //end of the straight line run of instructions starting at address
+    int run_end(uint16_t address) const;
+
+    std::string go_to(int address, bool fall_through) const;
+
+    void emit_instruction(std::ostream &out, uint16_t address, const Instruction &ins) const;
+};
+
+void Translator::analyse() {
+    std::vector<uint16_t> work = {PROGRAM_START};
+    leaders.insert(PROGRAM_START);
+
+    while (!work.empty()) {
+        uint16_t address = work.back();
+        work.pop_back();
+        if (instructions.contains(address) || !in_image(address)) {
+            continue;
+        }
+
+        Instruction ins;
+        ins.opcode = opcode_at(address);
+        ins.native = is_native(ins.opcode);
+        uint16_t next = address + 2;
+        uint16_t skip = address + 4;
+        uint16_t NNN = ins.opcode & 0x0FFF;
+        uint8_t NN = ins.opcode & 0x00FF;
+        //the successors of an instruction the interpreter runs are entered from the dispatch switch
+        bool branch = !ins.native;
+
+        switch (ins.opcode >> 12) {
+            case 0x0:
+                if (ins.opcode == 0x00E0) ins.successors = {next};
+                break;
+            case 0x1:
+                if (NNN == address) {
+                    //the interpreter detects jumps to themselves as idle loops
+                    ins.native = false;
+                } else {
+                    ins.successors = {NNN};
+                    branch = true;
+                }
+                break;
+            case 0x2:
+                //the return site is only reached through 00EE, but analysing it here lets it be translated
+                ins.successors = {NNN, next};
+                branch = true;
+                break;
+            case 0x3:
+            case 0x4:
+                ins.successors = {next, skip};
+                branch = true;
+                break;
+            case 0x5:
+                //5XY2 and 5XY3 are XO-CHIP register range saves and loads
+                if (ins.native) ins.successors = {next, skip};
+                else if ((ins.opcode & 0x000F) == 0x2 || (ins.opcode & 0x000F) == 0x3) ins.successors = {next};
+                branch = true;
+                break;
+            case 0x9:
+                if (ins.native) ins.successors = {next, skip};
+                branch = true;
+                break;
+            case 0xB:
+                break;
+            case 0xC:
+                ins.successors = {next};
+                break;
+            case 0xE:
+                if (NN == 0x9E || NN == 0xA1) ins.successors = {next, skip};
+                break;
+            case 0xF:
+                //F000 NNNN is XO-CHIP's 4 byte long index load, FN01 selects planes
+                if (ins.opcode == 0xF000) ins.successors = {skip};
+                else if (ins.native || NN == 0x07 || NN == 0x0A || NN == 0x01) ins.successors = {next};
+                break;
+            default:
+                //unknown opcodes stop the analysis, the bytes after them are most likely data
+                if (ins.native) ins.successors = {next};
+        }
+
+        //in XO-CHIP mode a skip steps over all 4 bytes of F000 NNNN, so only the interpreter knows where it goes
+        bool skips = (ins.opcode >> 12) != 0x2 && ins.successors.size() == 2;
+        if (skips && in_image(next) && opcode_at(next) == 0xF000) {
+            ins.native = false;
+            branch = true;
+            ins.successors.push_back(address + 6);
+        }
+
+        for (uint16_t successor: ins.successors) {
+            work.push_back(successor);
+            if (branch) leaders.insert(successor);
+        }
+        instructions[address] = ins;
+    }
+}
+
+size_t Translator::native_count() const {
+    return std::count_if(instructions.begin(), instructions.end(), [](const auto &entry) {
+        return entry.second.native;
+    });
+}
+
+bool Translator::falls_through(uint16_t address) const {
+    const Instruction &ins = instructions.at(address);
+    uint8_t kind = ins.opcode >> 12;
+    //draws return to the caller and jumps and skips go to a block leader. Memory writes continue the run
+    //unless they hit translated code, in which case they return to the caller as well
+    return ins.native && kind != 0x0 && kind != 0x1 && kind != 0x2 && kind != 0x3 && kind != 0x4 &&
+           kind != 0x5 && kind != 0x9 && kind != 0xB && kind != 0xD;
+}
+
+int Translator::run_end(uint16_t address) const {
+    int end = address + 2;
+    while (falls_through(end - 2) && instructions.contains(end) && instructions.at(end).native &&
+           !leaders.contains(end)) {
+        end += 2;
+    }
+    return end;
+}
+
+std::string Translator::go_to(int address, bool fall_through) const {
+    if (!instructions.contains(address) || !instructions.at(address).native) {
+        return std::format("{{ s.PC = 0x{}; return n; }}", hex(address));
+    }
+    if (fall_through && !leaders.contains(address)) {
+        return std::format("goto L{};", hex(address));
+    }
+    return std::format("goto B{};", hex(address));
+}
+
+void Translator::emit_instruction(std::ostream &out, uint16_t address, const Instruction &ins) const {
+    uint16_t opcode = ins.opcode;
+    uint8_t X = (opcode & 0x0F00) >> 8;
+    uint8_t Y = (opcode & 0x00F0) >> 4;
+    uint8_t N = opcode & 0x000F;
+    uint8_t NN = opcode & 0x00FF;
+    uint16_t NNN = opcode & 0x0FFF;
+    std::string a = hex(address);
+    std::string next = std::format("s.PC = 0x{}; return n;", hex(address + 2));
+    std::string vx = std::format("s.V[0x{:X}]", X);
+    std::string vy = std::format("s.V[0x{:X}]", Y);
+
+    //the interpreter runs everything else, jumps to those instructions return to it directly
+    if (!ins.native) {
+        return;
+    }
+    //leaders are entered through their block label, which checks the run first
+    if (leaders.contains(address)) {
+        out << std::format("    //{:04X}\n", opcode);
+    } else {
+        out << std::format("L{}: //{:04X}\n", a, opcode);
+    }
+    out << std::format("    if (n == budget) {{ s.PC = 0x{}; return n; }}\n", a);
+
+    //stack errors are reported by the interpreter
+    if (opcode == 0x00EE) out << std::format("    if (s.SP == 0) {{ s.PC = 0x{}; return n; }}\n", a);
+    if ((opcode >> 12) == 0x2) out << std::format("    if (s.SP >= STACK_SIZE) {{ s.PC = 0x{}; return n; }}\n", a);
+    out << "    n++;\n";
+
+    auto skip_if = [&](const std::string &condition) {
+        out << std::format("    if ({}) {}\n", condition, go_to(address + 4, false));
+        out << std::format("    {}\n", go_to(address + 2, false));
+    };
+
+    switch (opcode >> 12) {
+        case 0x0:
+            if (opcode == 0x00E0) {
+                out << "    clear_display(s);\n";
+                out << std::format("    {}\n", next);
+            } else {
+                out << "    s.PC = s.stack[--s.SP];\n    goto dispatch;\n";
+            }
+            return;
+        case 0x1:
+            out << std::format("    {}\n", go_to(NNN, false));
+            return;
+        case 0x2:
+            out << std::format("    s.stack[s.SP++] = 0x{};\n", hex(address + 2));
+            out << "    if (s.SP > s.stack_high_water) s.stack_high_water = s.SP;\n";
+            out << std::format("    {}\n", go_to(NNN, false));
+            return;
+        case 0x3:
+            skip_if(std::format("{} == 0x{:02X}", vx, NN));
+            return;
+        case 0x4:
+            skip_if(std::format("{} != 0x{:02X}", vx, NN));
+            return;
+        case 0x5:
+            skip_if(std::format("{} == {}", vx, vy));
+            return;
+        case 0x9:
+            skip_if(std::format("{} != {}", vx, vy));
+            return;
+        case 0x6:
+            out << std::format("    {} = 0x{:02X};\n", vx, NN);
+            break;
+        case 0x7:
+            out << std::format("    {} += 0x{:02X};\n", vx, NN);
+            break;
+        case 0x8:
+            //the same order of operations as Chip8::opcode_8XY_, so VF as an operand behaves identically
+            switch (N) {
+                case 0x0:
+                    out << std::format("    {} = {};\n", vx, vy);
+                    break;
+                case 0x1:
+                    out << std::format("    {} |= {};\n    s.V[0xF] = 0;\n", vx, vy);
+                    break;
+                case 0x2:
+                    out << std::format("    {} &= {};\n    s.V[0xF] = 0;\n", vx, vy);
+                    break;
+                case 0x3:
+                    out << std::format("    {} ^= {};\n    s.V[0xF] = 0;\n", vx, vy);
+                    break;
+                case 0x4:
+                    out << std::format("    {{ bool flag = ({} + {}) > 255; {} += {}; s.V[0xF] = flag; }}\n",
+                                       vx, vy, vx, vy);
+                    break;
+                case 0x5:
+                    out << std::format("    {{ bool flag = {} >= {}; {} -= {}; s.V[0xF] = flag; }}\n",
+                                       vx, vy, vx, vy);
+                    break;
+                case 0x6:
+                    out << std::format("    {{ {} = {}; bool flag = {} & 1; {} >>= 1; s.V[0xF] = flag; }}\n",
+                                       vx, vy, vx, vx);
+                    break;
+                case 0x7:
+                    out << std::format("    {{ bool flag = {} >= {}; {} = {} - {}; s.V[0xF] = flag; }}\n",
+                                       vy, vx, vx, vy, vx);
+                    break;
+                default:
+                    out << std::format("    {{ {} = {}; bool flag = ({} & 0x80) >> 7; {} <<= 1; s.V[0xF] = flag; }}\n",
+                                       vx, vy, vx, vx);
+                    break;
+            }
+            break;
+        case 0xA:
+            out << std::format("    s.I = 0x{};\n", hex(NNN));
+            break;
+        case 0xB:
+            out << std::format("    s.PC = 0x{} + s.V[0];\n    goto dispatch;\n", hex(NNN));
+            return;
+        case 0xD:
+            out << std::format("    draw_sprite(s, 0x{:X}, 0x{:X}, {});\n", X, Y, N);
+            out << std::format("    {}\n", next);
+            return;
+        case 0xF:
+            switch (NN) {
+                case 0x15:
+                    out << std::format("    s.delay = {};\n", vx);
+                    break;
+                case 0x18:
+                    out << std::format("    s.sound = {};\n", vx);
+                    break;
+                case 0x1E:
+                    out << std::format("    s.I += {};\n", vx);
+                    break;
+                case 0x29:
+                    out << std::format("    s.I = FONT_START + (({} & 0x0F) * 5);\n", vx);
+                    break;
+                case 0x33:
+                    //a write into translated code hands over to the dispatch switch, which checks the image
+                    out << std::format("    {{ uint8_t val = {}; for (int i = 2; i >= 0; --i) {{ "
+                                       "s.memory[(s.I + i) & (s.memory_size - 1)] = val % 10; val /= 10; }} }}\n", vx);
+                    out << std::format("    if (note_write(s, s.I, 3)) {{ {} }}\n", next);
+                    break;
+                case 0x55:
+                    out << std::format("    {{ bool written = note_write(s, s.I, {});\n", X + 1);
+                    out << std::format("      store_memory(s, s.I, s.V, {});\n", X + 1);
+                    out << std::format("      if (s.increment_I_on_index) s.I += {};\n", X + 1);
+                    out << std::format("      if (written) {{ {} }} }}\n", next);
+                    break;
+                case 0x65:
+                    out << std::format("    load_memory(s, s.I, s.V, {});\n", X + 1);
+                    out << std::format("    if (s.increment_I_on_index) s.I += {};\n", X + 1);
+                    break;
+            }
+            break;
+        default:
+            break;
+    }
+
+    out << std::format("    {}\n", go_to(address + 2, true));
+}
+
+std::string Translator::generate() const {
+    std::stringstream body;
+    for (const auto &[address, ins]: instructions) {
+        //a run is checked against the image once at its start, jumps and skips enter through this label
+        if (leaders.contains(address) && ins.native) {
+            body << std::format("B{}:\n    if (!unchanged(s, 0x{}, 0x{})) {{ s.PC = 0x{}; return n; }}\n",
+                                hex(address), hex(address), hex(run_end(address)), hex(address));
+        }
+        emit_instruction(body, address, ins);
+    }
+
+    std::stringstream out;
+    out << std::format("//generated by chip8-aot from {}, do not edit\n", name);
+    out << "#include <cstring>\n#include \"native.h\"\n\nnamespace {\n\n";
+    out << "const uint8_t image[] = {";
+    for (size_t i = 0; i < image.size(); ++i) {
+        out << (i % 16 == 0 ? "\n        " : " ") << std::format("0x{:02X},", image[i]);
+    }
+    out << "\n};\n\n";
+
+    out << "//true if the instructions from address up to end are still the ones that were translated\n"
+           "inline bool unchanged(const Chip8State &s, int address, int end) {\n"
+           "    return !s.native_code_written ||\n"
+           "           memcmp(s.memory + address, image + (address - PROGRAM_START), end - address) == 0;\n"
+           "}\n\n";
+
+    //only 00EE and BNNN jump back to the switch, an unused label would be a warning
+    bool dynamic_jumps = std::any_of(instructions.begin(), instructions.end(), [](const auto &entry) {
+        return entry.second.native && (entry.second.opcode == 0x00EE || (entry.second.opcode >> 12) == 0xB);
+    });
+    out << "int run(Chip8State &s, int budget) {\n    int n = 0;\n\n" << (dynamic_jumps ? "dispatch:\n" : "");
+    out << "    switch (s.PC) {\n";
+    for (const auto &[address, ins]: instructions) {
+        if (ins.native && leaders.contains(address)) {
+            out << std::format("        case 0x{}: goto B{};\n", hex(address), hex(address));
+        } else if (ins.native) {
+            out << std::format("        case 0x{}: if (!unchanged(s, 0x{}, 0x{})) return n; goto L{};\n",
+                               hex(address), hex(address), hex(run_end(address)), hex(address));
+        }
+    }
+    out << "        default: return n;\n    }\n\n";
+
+    out << body.str() << "}\n\n";
+
+    uint16_t low = MEMORY_SIZE, high = 0;
+    for (const auto &[address, ins]: instructions) {
+        if (ins.native) {
+            low = std::min<uint16_t>(low, address);
+            high = std::max<uint16_t>(high, address + 1);
+        }
+    }
+    out << std::format("const bool registered = register_native_rom({{\"{}\", image, sizeof(image), run, 0x{}, 0x{}}});\n",
+                       name, hex(low), hex(high));
+    out << "\n}\n";
+    return out.str();
+}
+
+int main(int argc, char *argv[]) {
+    int c;
+    std::string output;
+    std::string name;
+
+    const struct option longopts[] = {
+            {"output", required_argument, nullptr, 'o'},
+            {"name",   required_argument, nullptr, 'n'},
+            {nullptr,  0,                 nullptr, 0}
+    };
+
+    int index;
+
+    while ((c = getopt_long(argc, argv, "o:n:", longopts, &index)) != -1) {
+        switch (c) {
+            case 'o':
+                output = optarg;
+                break;
+            case 'n':
+                name = optarg;
+                break;
+            default:
+                return 1;
+        }
+    }
+
+    if (argc - optind != 1 || output.empty()) {
+        std::cerr << "Usage: chip8-aot input.ch8 -o output.cpp [-n name]\n";
+        return 1;
+    }
+
+    std::string input = argv[optind];
+    std::ifstream file(input, std::ios::binary);
+    if (!file) {
+        std::cerr << "ERROR: Failed to open input file\n";
+        return 1;
+    }
+    std::vector<uint8_t> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (image.empty() || image.size() > MEMORY_SIZE - PROGRAM_START) {
+        std::cerr << "ERROR: Input file is empty or too big\n";
+        return 1;
+    }
+
+    if (name.empty()) {
+        name = input.substr(input.find_last_of("/\\") + 1);
+    }
+    //the name ends up in a string literal
+    std::replace_if(name.begin(), name.end(), [](char ch) {
+        return !isalnum(static_cast<unsigned char>(ch)) && ch != '.' && ch != '-' && ch != '_';
+    }, '_');
+
+    Translator translator(image, name);
+    translator.analyse();
+
+    std::ofstream out(output);
+    if (!out) {
+        std::cerr << "ERROR: Failed to open output file\n";
+        return 1;
+    }
+    out << translator.generate();
+
+    std::cout << std::format("{}: translated {} of {} reachable instructions\n", name,
+                             translator.native_count(), translator.instruction_count());
+    return 0;
+}